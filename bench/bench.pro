@@ -0,0 +1,56 @@
+#-------------------------------------------------
+#
+# Benchmarks for Komiq's page pipeline. Built along with the viewer by the
+# top-level komiq.pro, or on its own; sources are shared with the
+# application.
+#
+# Benchmarks run on comics from disk. Generate a reproducible one first, e.g.
+# "komiq-bench corpus /tmp/corpus method=deflated", then run a benchmark on
+# it, e.g. "komiq-bench pipeline /tmp/corpus/corpus.cbz". See README.md.
+#
+#-------------------------------------------------
+
+QT += core gui
+
+TARGET = komiq-bench
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+INCLUDEPATH += ../src
+
+win32: LIBS += -lpsapi
+
+# Same as komiq.pro.
+!miniz_inflate: DEFINES += ZIP_FAST_INFLATE
+no_trace: DEFINES += KOMIQ_NO_TRACE
+
+SOURCES += \
+    main.cpp \
+    classify.cpp \
+    corpus.cpp \
+    crc.cpp \
+    inflate.cpp \
+    pipeline.cpp \
+    resample.cpp \
+    ../src/zip/zip.c \
+    ../src/zip/fastinflate.c \
+    ../src/entryiterator.cpp \
+    ../src/image.cpp \
+    ../src/resample.cpp \
+    ../src/trace.cpp \
+    ../src/verifiedarchives.cpp
+
+HEADERS += \
+    benchmarks.h \
+    ../src/zip/miniz.h \
+    ../src/zip/zip.h \
+    ../src/zip/fastinflate.h \
+    ../src/entryiterator.h \
+    ../src/image.h \
+    ../src/resample.h \
+    ../src/trace.h \
+    ../src/verifiedarchives.h
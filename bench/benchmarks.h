@@ -0,0 +1,17 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QStringList>
+
+// Each benchmark takes the arguments after its name, prints results to
+// stdout, and returns the process exit code.
+int benchClassify(const QStringList &args);
+int benchCrc(const QStringList &args);
+int benchInflate(const QStringList &args);
+int benchPipeline(const QStringList &args);
+int benchResample(const QStringList &args);
+
+// Writes a synthetic comic for the benchmarks above to read.
+int makeCorpus(const QStringList &args);
+
+#endif // BENCHMARKS_H
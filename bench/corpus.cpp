@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstring>
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QMap>
+#include <QTextStream>
+#include <QVector>
+#include "benchmarks.h"
+#include "zip/zip.h"
+
+namespace
+{
+
+// Parameters, with defaults. Anything else on the command line is an error.
+const char *const defaults[][2] = {
+    {"name", "corpus"},         // file or directory name, without suffix
+    {"container", "cbz"},       // cbz, or dir for a directory tree
+    {"method", "stored"},       // stored or deflated (cbz only)
+    {"pages", "24"},
+    {"size", "1600x2400"},      // of a single page; spreads are twice as wide
+    {"format", "jpeg"},         // anything QImageWriter supports, e.g. png
+    {"quality", "90"},
+    {"gray", "0"},              // 1 for grayscale pages, like most manga
+    {"noise", "0"},             // 1 for incompressible pages
+    {"folders", "0"},           // nesting depth of chapter folders
+    {"spreads", "0"},           // every n-th page is a horizontal spread
+    {"seed", "1"},
+};
+
+struct Random
+{
+    Random(quint32 seed) : state(seed ? seed : 1) {}
+
+    quint32 next()
+    {
+        this->state = this->state * 1103515245 + 12345;
+        return this->state >> 8;
+    }
+
+    quint32 state;
+};
+
+// Draws something page-like: panels of flat tones with borders, and a bar
+// code of the page number along the top, so pages differ from each other.
+// Noise replaces the tones with random pixels, which no format compresses.
+QImage drawPage(int index, int w, int h, bool gray, bool noise, quint32 seed)
+{
+    QImage image(w, h, gray ? QImage::Format_Grayscale8
+                            : QImage::Format_RGB32);
+    int bpp = gray ? 1 : 4;
+    Random random(seed * 7919 + static_cast<quint32>(index));
+
+    // Three rows of one or two panels.
+    struct Panel { int x0, y0, x1, y1; quint32 tone; };
+    QVector<Panel> panels;
+    int margin = std::max(std::min(w, h) / 40, 1);
+    for (int row = 0; row < 3; row++)
+    {
+        int y0 = margin + row * (h - margin) / 3;
+        int y1 = (row + 1) * (h - margin) / 3;
+        int split = random.next() % 2 ? w / 3 + random.next() % (w / 3 + 1)
+                                      : w;
+        panels.append({margin, y0, split - margin, y1, random.next()});
+        if (split < w)
+            panels.append({split, y0, w - margin, y1, random.next()});
+    }
+
+    for (int y = 0; y < h; y++)
+    {
+        auto line = image.scanLine(y);
+        for (int x = 0; x < w; x++)
+        {
+            quint32 color = 0xffffffff;
+            for (const auto &panel : panels)
+            {
+                if (x < panel.x0 || x >= panel.x1
+                        || y < panel.y0 || y >= panel.y1)
+                    continue;
+                bool border = x - panel.x0 < 3 || panel.x1 - x <= 3
+                        || y - panel.y0 < 3 || panel.y1 - y <= 3;
+                color = border ? 0xff000000
+                               : (noise ? random.next() : panel.tone)
+                                 | 0xff000000;
+                break;
+            }
+
+            // The page number, in binary, as bars in the top margin.
+            if (y < margin / 2 && x < 32 * margin)
+                color = (index >> (x / margin)) & 1 ? 0xff000000 : 0xffffffff;
+
+            if (gray)
+                line[x] = static_cast<uchar>(qGray(color));
+            else
+                std::memcpy(line + x * bpp, &color, sizeof(color));
+        }
+    }
+    return image;
+}
+
+}   // (anonymous namespace)
+
+// Writes a comic of synthetic pages, as an archive or a directory tree, so
+// benchmarks can run on something reproducible. Pathological cases are just
+// extreme parameters, e.g. "pages=50000 size=64x96" for an archive with a
+// huge central directory, or "pages=1 size=10000x7000 format=png noise=1" for
+// a single ~200 MB page.
+int makeCorpus(const QStringList &args)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    if (args.isEmpty())
+    {
+        err << "usage: komiq-bench corpus <dir> [name=value ...]" << endl;
+        return 2;
+    }
+    QMap<QString, QString> options;
+    for (const auto &option : defaults)
+        options[option[0]] = option[1];
+    for (int i = 1; i < args.size(); i++)
+    {
+        auto pair = args[i].split('=');
+        if (pair.size() != 2 || !options.contains(pair[0]))
+        {
+            err << "unknown option " << args[i] << "; options (and defaults):"
+                << endl;
+            for (const auto &option : defaults)
+                err << "  " << option[0] << "=" << option[1] << endl;
+            return 2;
+        }
+        options[pair[0]] = pair[1];
+    }
+
+    auto size = options["size"].split('x');
+    int w = size.value(0).toInt();
+    int h = size.value(1).toInt();
+    int pages = options["pages"].toInt();
+    bool archive = options["container"] == "cbz";
+    QByteArray format = options["format"].toLatin1();
+    if (w <= 0 || h <= 0 || pages <= 0
+            || (!archive && options["container"] != "dir")
+            || !QImageWriter::supportedImageFormats().contains(format))
+    {
+        err << "bad size, page count, container or image format" << endl;
+        return 2;
+    }
+    int quality = options["quality"].toInt();
+    bool gray = options["gray"].toInt();
+    bool noise = options["noise"].toInt();
+    int folders = std::max(options["folders"].toInt(), 0);
+    int spreads = std::max(options["spreads"].toInt(), 0);
+    quint32 seed = options["seed"].toUInt();
+
+    QDir dir(args[0]);
+    if (!dir.mkpath("."))
+    {
+        err << "cannot create " << args[0] << endl;
+        return 1;
+    }
+    QString target = dir.filePath(options["name"] + (archive ? ".cbz" : ""));
+    bool existed = QFileInfo::exists(target);
+    zip_t *zip = nullptr;
+    if (archive)
+    {
+        int level = options["method"] == "deflated" ? 6 : 0;
+        zip = zip_open(QFile::encodeName(target).constData(), level, 'w');
+        if (!zip)
+        {
+            err << "cannot write " << target << endl;
+            return 1;
+        }
+    }
+
+    // Don't leave a partial corpus behind, which could pass for a whole one.
+    // A directory is only removed if this made it.
+    auto discard = [&]() {
+        if (zip)
+        {
+            zip_close(zip);
+            QFile::remove(target);
+        }
+        else if (!existed)
+        {
+            QDir(target).removeRecursively();
+        }
+    };
+
+    // Chapters split the pages evenly, nesting one folder per level.
+    int chapters = folders ? std::max(pages / 8, 2) : 1;
+    qint64 bytes = 0;
+    for (int i = 0; i < pages; i++)
+    {
+        QString path;
+        int chapter = i * chapters / pages;
+        for (int level = 0; level < folders; level++)
+            path += QString("ch%1/").arg(chapter, 3, 10, QChar('0'));
+        path += QString("%1.%2").arg(i, 5, 10, QChar('0'))
+                .arg(QString::fromLatin1(format));
+
+        bool spread = spreads && i % spreads == spreads - 1;
+        QImage page = drawPage(i, spread ? w * 2 : w, h, gray, noise, seed);
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, format);
+        writer.setQuality(quality);
+        if (!writer.write(page))
+        {
+            err << "cannot encode " << path << ": " << writer.errorString()
+                << endl;
+            discard();
+            return 1;
+        }
+        bytes += data.size();
+
+        bool ok;
+        if (archive)
+        {
+            ok = zip_entry_open(zip, path.toUtf8().constData()) == 0;
+            ok = ok && zip_entry_write(zip, data.constData(),
+                                       static_cast<size_t>(data.size())) == 0;
+            ok = zip_entry_close(zip) == 0 && ok;
+        }
+        else
+        {
+            QFile file(QDir(target).filePath(path));
+            ok = QDir(target).mkpath(QFileInfo(file).path())
+                    && file.open(QIODevice::WriteOnly)
+                    && file.write(data) == data.size();
+        }
+        if (!ok)
+        {
+            err << "cannot write " << path << endl;
+            discard();
+            return 1;
+        }
+    }
+    if (zip)
+        zip_close(zip);
+
+    out << target << ": " << pages << " pages, " << (bytes >> 20) << " MiB"
+        << endl;
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include "benchmarks.h"
+
+#define MINIZ_HEADER_FILE_ONLY
+#include "zip/miniz.h"
+
+namespace
+{
+
+// How mz_crc32() used to work, for comparison.
+mz_ulong nibbleCrc32(mz_ulong crc, const unsigned char *ptr, size_t len)
+{
+    static const mz_uint32 table[16] = {
+        0,          0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    mz_uint32 crcu32 = ~static_cast<mz_uint32>(crc);
+    while (len--)
+    {
+        mz_uint8 b = *ptr++;
+        crcu32 = (crcu32 >> 4) ^ table[(crcu32 & 0xF) ^ (b & 0xF)];
+        crcu32 = (crcu32 >> 4) ^ table[(crcu32 & 0xF) ^ (b >> 4)];
+    }
+    return ~crcu32;
+}
+
+mz_ulong measure(QTextStream &out, const char *label,
+                 mz_ulong (*crc32)(mz_ulong, const unsigned char *, size_t),
+                 const QVector<unsigned char> &data, int rounds)
+{
+    mz_ulong crc = MZ_CRC32_INIT;
+    QElapsedTimer timer;
+    timer.start();
+    for (int round = 0; round < rounds; round++)
+        crc = crc32(MZ_CRC32_INIT, data.constData(), data.size());
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    out << label << ": "
+        << qRound64(data.size() * double(rounds) / seconds / (1 << 20))
+        << " MB/s (crc " << hex << crc << dec << ")" << endl;
+    return crc;
+}
+
+}   // (anonymous namespace)
+
+int benchCrc(const QStringList &args)
+{
+    QTextStream out(stdout);
+    int megabytes = args.size() > 0 ? std::max(args[0].toInt(), 1) : 64;
+    int rounds = args.size() > 1 ? std::max(args[1].toInt(), 1) : 5;
+
+    // Anything but zeroes; the routines don't care about the content.
+    QVector<unsigned char> data(megabytes << 20);
+    quint32 seed = 1;
+    for (auto &b : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<unsigned char>(seed >> 16);
+    }
+
+    out << megabytes << " MiB, " << rounds << " rounds" << endl;
+    mz_ulong expected = measure(out, "nibble", nibbleCrc32, data, rounds);
+    bool ok = measure(out, "slice-by-8", mz_crc32_portable, data, rounds)
+            == expected;
+    ok = measure(out, "mz_crc32", mz_crc32, data, rounds) == expected && ok;
+    if (!ok)
+    {
+        QTextStream(stderr) << "CRC mismatch" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstring>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include "benchmarks.h"
+#include "entryiterator.h"
+#include "zip/fastinflate.h"
+
+#define MINIZ_HEADER_FILE_ONLY
+#include "zip/miniz.h"
+
+namespace
+{
+
+// A deflated entry, as stored in the archive.
+struct Sample
+{
+    QByteArray compressed;
+    size_t size;
+    mz_uint32 crc;
+};
+
+void collect(const QString &path, QVector<Sample> &samples)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0)
+        return;
+    auto data = file.map(0, file.size());
+    if (!data)
+        return;
+
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    if (!mz_zip_reader_init_mem(&zip, data, static_cast<size_t>(file.size()),
+                                0))
+        return;
+    for (mz_uint i = 0; i < mz_zip_reader_get_num_files(&zip); i++)
+    {
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&zip, i, &stat)
+                || stat.m_method != MZ_DEFLATED
+                || mz_zip_reader_is_file_a_directory(&zip, i))
+            continue;
+        size_t size = 0;
+        void *compressed = mz_zip_reader_extract_to_heap(
+                    &zip, i, &size, MZ_ZIP_FLAG_COMPRESSED_DATA);
+        if (!compressed)
+            continue;
+        Sample sample;
+        sample.compressed = QByteArray(static_cast<const char *>(compressed),
+                                       static_cast<int>(size));
+        sample.size = static_cast<size_t>(stat.m_uncomp_size);
+        sample.crc = stat.m_crc32;
+        samples.append(sample);
+        mz_free(compressed);
+    }
+    mz_zip_reader_end(&zip);
+}
+
+bool tinflInflate(const Sample &sample, QByteArray &out)
+{
+    auto size = tinfl_decompress_mem_to_mem(
+                out.data(), sample.size, sample.compressed.constData(),
+                static_cast<size_t>(sample.compressed.size()),
+                TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+    return size == sample.size;
+}
+
+bool fastInflate(const Sample &sample, QByteArray &out)
+{
+    size_t size = 0;
+    return fast_inflate(sample.compressed.constData(),
+                        static_cast<size_t>(sample.compressed.size()),
+                        out.data(), sample.size, &size) == 0
+            && size == sample.size;
+}
+
+void measure(QTextStream &out, const char *label,
+             bool (*inflate)(const Sample &, QByteArray &),
+             const QVector<Sample> &samples, QByteArray &buffer, int rounds)
+{
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (const auto &sample : samples)
+        {
+            inflate(sample, buffer);
+            bytes += static_cast<qint64>(sample.size);
+        }
+    }
+    double seconds = timer.nsecsElapsed() / 1e9;
+    out << label << ": " << qRound64(bytes / seconds / (1 << 20)) << " MB/s"
+        << endl;
+}
+
+}   // (anonymous namespace)
+
+int benchInflate(const QStringList &args)
+{
+    QTextStream out(stdout);
+    if (args.isEmpty())
+    {
+        QTextStream(stderr) << "usage: komiq-bench inflate <dir> [rounds]"
+                            << endl;
+        return 2;
+    }
+    int rounds = args.size() > 1 ? std::max(args[1].toInt(), 1) : 5;
+
+    QVector<Sample> samples;
+    QDirIterator::IteratorFlags flags =
+            QDirIterator::Subdirectories | QDirIterator::FollowSymlinks;
+    QDirIterator diriter(args[0], QDir::Files, flags);
+    while (!diriter.next().isEmpty())
+    {
+        if (EntryIterator::isZipArchive(diriter.fileInfo()))
+            collect(diriter.filePath(), samples);
+    }
+    if (samples.isEmpty())
+    {
+        QTextStream(stderr) << "no deflated entries in " << args[0] << endl;
+        return 1;
+    }
+
+    // Check both inflaters against each other, and the stored CRC-32, before
+    // timing anything.
+    size_t largest = 0;
+    qint64 compressed = 0, uncompressed = 0;
+    for (const auto &sample : samples)
+    {
+        largest = std::max(largest, sample.size);
+        compressed += sample.compressed.size();
+        uncompressed += static_cast<qint64>(sample.size);
+    }
+    QByteArray expected(static_cast<int>(largest), '\0');
+    QByteArray actual(static_cast<int>(largest), '\0');
+    int mismatches = 0;
+    for (const auto &sample : samples)
+    {
+        auto data = reinterpret_cast<const mz_uint8 *>(expected.constData());
+        if (!tinflInflate(sample, expected)
+                || mz_crc32(MZ_CRC32_INIT, data, sample.size) != sample.crc)
+            continue;   // Broken entry; miniz can't read it either.
+        if (!fastInflate(sample, actual)
+                || memcmp(actual.constData(), expected.constData(),
+                          sample.size) != 0)
+            mismatches++;
+    }
+
+    out << samples.size() << " entries, " << (compressed >> 20) << " MiB -> "
+        << (uncompressed >> 20) << " MiB, " << rounds << " rounds" << endl;
+    if (mismatches)
+    {
+        QTextStream(stderr) << mismatches << " entries inflated differently"
+                            << endl;
+        return 1;
+    }
+    measure(out, "miniz", tinflInflate, samples, expected, rounds);
+    measure(out, "fast_inflate", fastInflate, samples, actual, rounds);
+    return 0;
+}
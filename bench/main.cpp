@@ -0,0 +1,53 @@
+#include <QCoreApplication>
+#include <QTextStream>
+#include "benchmarks.h"
+
+namespace
+{
+
+struct Benchmark
+{
+    const char *name;
+    const char *usage;
+    int (*run)(const QStringList &args);
+};
+
+const Benchmark benchmarks[] = {
+    {"classify", "classify <dir> [rounds]", benchClassify},
+    {"corpus", "corpus <dir> [name=value ...]", makeCorpus},
+    {"crc", "crc [megabytes] [rounds]", benchCrc},
+    {"inflate", "inflate <dir> [rounds]", benchInflate},
+    {"pipeline", "pipeline <path> [rounds] [json-file]", benchPipeline},
+    {"resample", "resample [width height] [rounds]", benchResample},
+};
+
+int usage()
+{
+    QTextStream err(stderr);
+    err << "usage: komiq-bench <benchmark> [args ...]" << endl
+        << endl
+        << "benchmarks:" << endl;
+    for (const auto &benchmark : benchmarks)
+        err << "  " << benchmark.usage << endl;
+    return 2;
+}
+
+}   // (anonymous namespace)
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("komiq-bench");
+
+    QStringList args = a.arguments().mid(1);
+    if (args.isEmpty())
+        return usage();
+
+    QString name = args.takeFirst();
+    for (const auto &benchmark : benchmarks)
+    {
+        if (name == QLatin1String(benchmark.name))
+            return benchmark.run(args);
+    }
+    return usage();
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QVector>
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include "benchmarks.h"
+#include "entryiterator.h"
+#include "image.h"
+
+#define MINIZ_HEADER_FILE_ONLY
+#include "zip/miniz.h"
+
+namespace
+{
+
+// Timings of one stage, in nanoseconds, one sample per call.
+struct Stage
+{
+    Stage(const char *name = "") : name(name) {}
+
+    qint64 percentile(double p) const
+    {
+        if (this->samples.isEmpty())
+            return 0;
+        auto index = static_cast<int>(p * (this->samples.size() - 1) + 0.5);
+        return this->samples[index];
+    }
+
+    const char *name;
+    QVector<qint64> samples;
+};
+
+qint64 peakRss()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                                sizeof(counters)))
+        return 0;
+    return static_cast<qint64>(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef Q_OS_MACOS
+    return static_cast<qint64>(usage.ru_maxrss);
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+QString milliseconds(qint64 nanoseconds)
+{
+    return QString::number(nanoseconds / 1e6, 'f', 2);
+}
+
+}   // (anonymous namespace)
+
+// Runs the viewer's page pipeline over a directory, archive or image, on this
+// thread, stage by stage:
+//
+//   open     building the entry iterator, which walks directories
+//   list     listing a container (an archive is opened here)
+//   extract  reading a page, i.e. inflating it and checking its CRC-32
+//   crc      CRC-32 of the page alone, for reference
+//   decode   decoding the page at full size
+//   mipmaps  building the page's half-size copies
+//   scale    scaling the page to fit the viewport
+//
+// Archives are verified in the background when first opened, which would
+// compete with extraction; the benchmark waits for that after listing. Pages
+// of verified archives skip the CRC check on extract, as in the viewer.
+int benchPipeline(const QStringList &args)
+{
+    QTextStream out(stdout);
+    if (args.isEmpty())
+    {
+        QTextStream(stderr) << "usage: komiq-bench pipeline <path> [rounds] "
+                               "[json-file]" << endl;
+        return 2;
+    }
+    QFileInfo source(args[0]);
+    int rounds = args.size() > 1 ? std::max(args[1].toInt(), 1) : 1;
+    QString jsonPath = args.size() > 2 ? args[2] : QString();
+    const int viewportWidth = 1920;
+    const int viewportHeight = 1080;
+    if (!EntryIterator::isValidEntry(source))
+    {
+        QTextStream(stderr) << "nothing to read in " << args[0] << endl;
+        return 1;
+    }
+
+    QVector<Stage> stages = {
+        "open", "list", "extract", "crc", "decode", "mipmaps", "scale",
+    };
+    enum { Open, List, Extract, Crc, Decode, Mipmaps, Scale };
+
+    int pages = 0;
+    int failures = 0;
+    qint64 bytes = 0;
+    QElapsedTimer total;
+    total.start();
+    for (int round = 0; round < rounds; round++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        EntryIterator iterator(QList<QFileInfo>() << source);
+        stages[Open].samples.append(timer.nsecsElapsed());
+
+        // Containers are listed as pages in them are first asked for; asking
+        // for the page after the last listed one lists the next container.
+        while (!iterator.isComplete())
+        {
+            timer.restart();
+            iterator.sizeAt(iterator.count());
+            stages[List].samples.append(timer.nsecsElapsed());
+        }
+        EntryIterator::waitForVerification();
+
+        for (int i = 0; i < iterator.count(); i++)
+        {
+            timer.restart();
+            auto data = iterator.pageAt(i);
+            stages[Extract].samples.append(timer.nsecsElapsed());
+            QByteArray page = data.bytes();
+            bytes += page.size();
+
+            timer.restart();
+            mz_crc32(MZ_CRC32_INIT,
+                     reinterpret_cast<const unsigned char *>(page.constData()),
+                     static_cast<size_t>(page.size()));
+            stages[Crc].samples.append(timer.nsecsElapsed());
+
+            timer.restart();
+            QBuffer buffer(&page);
+            buffer.open(QIODevice::ReadOnly);
+            QImage decoded = QImageReader(&buffer).read();
+            stages[Decode].samples.append(timer.nsecsElapsed());
+            pages++;
+            if (decoded.isNull())
+            {
+                failures++;
+                continue;
+            }
+
+            timer.restart();
+            Image image(decoded);
+            image.buildMipmaps();
+            stages[Mipmaps].samples.append(timer.nsecsElapsed());
+
+            timer.restart();
+            image.renderToFit(viewportWidth, viewportHeight);
+            stages[Scale].samples.append(timer.nsecsElapsed());
+        }
+    }
+    double seconds = total.nsecsElapsed() / 1e9;
+    for (auto &stage : stages)
+        std::sort(stage.samples.begin(), stage.samples.end());
+
+    out << pages / rounds << " pages, " << (bytes / rounds) / (1 << 20)
+        << " MiB, " << rounds << " rounds";
+    if (failures)
+        out << ", " << failures / rounds << " failed to decode";
+    out << endl;
+    out << "stage      count     p50 ms     p95 ms     max ms" << endl;
+    for (const auto &stage : stages)
+    {
+        out << QString(stage.name).leftJustified(8)
+            << QString::number(stage.samples.size()).rightJustified(8)
+            << milliseconds(stage.percentile(0.5)).rightJustified(11)
+            << milliseconds(stage.percentile(0.95)).rightJustified(11)
+            << milliseconds(stage.percentile(1.0)).rightJustified(11)
+            << endl;
+    }
+    out << "pages/s: " << QString::number(pages / seconds, 'f', 1) << endl;
+    out << "peak RSS: " << peakRss() / (1 << 20) << " MiB" << endl;
+
+    if (jsonPath.isEmpty())
+        return 0;
+
+    QJsonObject result;
+    result["source"] = source.absoluteFilePath();
+    result["rounds"] = rounds;
+    result["pages"] = pages / rounds;
+    result["failures"] = failures / rounds;
+    result["bytes"] = bytes / rounds;
+    result["seconds"] = seconds;
+    result["pagesPerSecond"] = pages / seconds;
+    result["peakRss"] = peakRss();
+    QJsonObject viewport;
+    viewport["width"] = viewportWidth;
+    viewport["height"] = viewportHeight;
+    result["viewport"] = viewport;
+    QJsonArray stageResults;
+    for (const auto &stage : stages)
+    {
+        QJsonObject entry;
+        entry["name"] = stage.name;
+        entry["count"] = stage.samples.size();
+        entry["p50"] = stage.percentile(0.5) / 1e6;
+        entry["p95"] = stage.percentile(0.95) / 1e6;
+        entry["max"] = stage.percentile(1.0) / 1e6;
+        stageResults.append(entry);
+    }
+    result["stages"] = stageResults;
+
+    QFile file(jsonPath);
+    bool opened = jsonPath == "-"
+            ? file.open(stdout, QIODevice::WriteOnly)
+            : file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!opened)
+    {
+        QTextStream(stderr) << "cannot write " << jsonPath << endl;
+        return 1;
+    }
+    out.flush();
+    file.write(QJsonDocument(result).toJson());
+    return 0;
+}
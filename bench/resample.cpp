@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTextStream>
+#include "benchmarks.h"
+#include "resample.h"
+
+namespace
+{
+
+// Noise over a gradient, so neither scaler can take shortcuts.
+QImage makeImage(int w, int h, QImage::Format format)
+{
+    QImage image(w, h, format);
+    quint32 seed = 1;
+    for (int y = 0; y < h; y++)
+    {
+        auto line = image.scanLine(y);
+        for (int x = 0; x < image.bytesPerLine(); x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            line[x] = static_cast<uchar>((x + y) / 8 + (seed >> 27));
+        }
+    }
+    return image;
+}
+
+template <typename Scale>
+void measure(QTextStream &out, const char *label, Scale scale, int rounds)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int round = 0; round < rounds; round++)
+        scale();
+    out << "  " << label << ": "
+        << QString::number(timer.nsecsElapsed() / 1e6 / rounds, 'f', 1)
+        << " ms" << endl;
+}
+
+}   // (anonymous namespace)
+
+int benchResample(const QStringList &args)
+{
+    QTextStream out(stdout);
+    int w = args.size() > 1 ? std::max(args[0].toInt(), 1) : 3840;
+    int h = args.size() > 1 ? std::max(args[1].toInt(), 1) : 2160;
+    int rounds = args.size() > 2 ? std::max(args[2].toInt(), 1) : 10;
+
+    // Typical reductions: to a 1080p screen, and half of one (a page of a
+    // spread).
+    const QSize targets[] = {
+        QSize(w, h).scaled(1920, 1080, Qt::KeepAspectRatio),
+        QSize(w, h).scaled(960, 1080, Qt::KeepAspectRatio),
+    };
+    const QImage::Format formats[] = {
+        QImage::Format_RGB32,
+        QImage::Format_Grayscale8,
+    };
+
+    for (auto format : formats)
+    {
+        QImage image = makeImage(w, h, format);
+        for (const auto &target : targets)
+        {
+            int tw = std::max(target.width(), 1);
+            int th = std::max(target.height(), 1);
+            out << w << "x" << h << " -> " << tw << "x" << th
+                << (format == QImage::Format_Grayscale8 ? " gray" : " rgb")
+                << endl;
+            measure(out, "QImage::scaled (fast)", [&]() {
+                image.scaled(tw, th, Qt::IgnoreAspectRatio,
+                             Qt::FastTransformation);
+            }, rounds);
+            measure(out, "QImage::scaled (smooth)", [&]() {
+                image.scaled(tw, th, Qt::IgnoreAspectRatio,
+                             Qt::SmoothTransformation);
+            }, rounds);
+            measure(out, "resampled", [&]() {
+                resampled(image, tw, th);
+            }, rounds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Builds the viewer and its benchmarks. Each can also be built on its own,
+# from src/komiq.pro and bench/bench.pro.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = app bench
+
+app.file = src/komiq.pro
+bench.file = bench/bench.pro
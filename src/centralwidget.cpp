@@ -1,17 +1,63 @@
 #include <QApplication>
 #include <QFileInfo>
+#include <QFontDatabase>
 #include <QGestureEvent>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QMimeData>
+#include <QRunnable>
 #include <QTimer>
 #include "centralwidget.h"
 #include "entryiterator.h"
+#include "pageloader.h"
+#include "seeker.h"
+#include "thumbnailer.h"
+#include "trace.h"
+
+// Scales a page smoothly off the GUI thread. The image is handed back with the
+// result, so the last copy of it is never released on the worker thread.
+class CentralWidget::ScaleJob : public QRunnable
+{
+public:
+    ScaleJob(CentralWidget *widget, int serial, const Image &image,
+             int w, int h) :
+        widget(widget), serial(serial), image(image), w(w), h(h) {}
+
+    void run() override
+    {
+        // The job is deleted once run() returns, so don't capture it.
+        CentralWidget *widget = this->widget;
+        int serial = this->serial;
+        Image image = this->image;
+        int w = this->w;
+        int h = this->h;
+        QImage scaled = image.renderToFit(w, h);
+        QMetaObject::invokeMethod(widget, [=]() {
+            widget->receiveScaled(serial, image, w, h, scaled);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    CentralWidget *widget;
+    int serial;
+    Image image;
+    int w;
+    int h;
+};
 
 CentralWidget::CentralWidget(QWidget *parent) :
-    QWidget(parent), iterator(nullptr),
+    QWidget(parent), loader(nullptr), prefetchDepth(8),
+    prefetchBudget(Q_INT64_C(512) << 20), cacheBudget(Q_INT64_C(1024) << 20),
+    decodeToFit(true),
+    index1(NoPage), index2(NoPage),
+    loadingStep(0), loadingFrom(0),
     label1(new QLabel()), label2(new QLabel()),
-    doubleTapTimer(new QTimer(this))
+    doubleTapTimer(new QTimer(this)),
+    resizeTimer(new QTimer(this)), resizing(false),
+    scaleSerial(0), scalesPending(0),
+    turnWaited(false), lastTurnTime(0), turnHits(0), turnMisses(0),
+    hud(new QLabel(this)), hudTimer(new QTimer(this)), hudBytesRead(0),
+    thumbnailer(nullptr), seeker(new Seeker(this))
 {
     this->setAcceptDrops(true);
     this->setAutoFillBackground(true);
@@ -34,11 +80,35 @@ CentralWidget::CentralWidget(QWidget *parent) :
     this->setLayout(layout);
 
     this->doubleTapTimer->setSingleShot(true);
+
+    this->resizeTimer->setSingleShot(true);
+    this->resizeTimer->setInterval(150);
+    this->connect(this->resizeTimer, &QTimer::timeout,
+                  this, &CentralWidget::settleSize);
+
+    // The overlay floats over the pages, outside the layout.
+    this->hud->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    this->hud->setStyleSheet("background: rgba(0, 0, 0, 160); color: white;"
+                             "padding: 6px;");
+    this->hud->setAttribute(Qt::WA_TransparentForMouseEvents);
+    this->hud->move(8, 8);
+    this->hud->hide();
+
+    this->hudTimer->setInterval(500);
+    this->connect(this->hudTimer, &QTimer::timeout,
+                  this, &CentralWidget::updateHud);
+
+    this->seeker->hide();
+    this->connect(this->seeker, &Seeker::pageSelected,
+                  this, &CentralWidget::goToPage);
 }
 
 CentralWidget::~CentralWidget()
 {
-    delete this->iterator;
+    this->scalePool.clear();
+    this->scalePool.waitForDone();
+    delete this->thumbnailer;
+    delete this->loader;
 }
 
 bool CentralWidget::openLocalPaths(const QStringList &paths)
@@ -57,6 +127,89 @@ bool CentralWidget::openLocalPaths(const QStringList &paths)
     return true;
 }
 
+void CentralWidget::setPrefetch(int depth, qint64 budget)
+{
+    this->prefetchDepth = depth;
+    this->prefetchBudget = budget;
+    if (this->loader)
+        this->loader->setPrefetch(depth, budget);
+}
+
+void CentralWidget::setCacheBudget(qint64 budget)
+{
+    this->cacheBudget = budget;
+    if (this->loader)
+        this->loader->setCacheBudget(budget);
+}
+
+void CentralWidget::setDecodeToFit(bool enabled)
+{
+    this->decodeToFit = enabled;
+    this->updateViewport();
+}
+
+void CentralWidget::setHudVisible(bool visible)
+{
+    if (visible)
+    {
+        this->hudClock.start();
+        this->hudBytesRead = this->loader ? this->loader->stats().bytesRead : 0;
+        this->updateHud();
+        this->hud->raise();
+        this->hudTimer->start();
+    }
+    else
+    {
+        this->hudTimer->stop();
+    }
+    this->hud->setVisible(visible);
+}
+
+// Thumbnails are only made while the seeker is shown.
+void CentralWidget::setSeekerVisible(bool visible)
+{
+    if (visible)
+    {
+        this->seeker->raise();
+        this->updateSeeker();
+    }
+    else if (this->thumbnailer)
+    {
+        this->thumbnailer->cancel();
+    }
+    this->seeker->setVisible(visible);
+}
+
+// Show the pages that go with the current one, and thumbnail them from the
+// current page out. The thumbnailer is made when first needed, and reads with
+// the loader's iterator.
+void CentralWidget::updateSeeker()
+{
+    if (!this->loader || this->index1 < 0)
+        return;
+    auto iterator = this->loader->iterator();
+    int first, count;
+    if (!iterator || !iterator->span(this->index1, &first, &count))
+        return;
+    if (!this->thumbnailer)
+    {
+        this->thumbnailer = new Thumbnailer(iterator, this);
+        this->connect(this->thumbnailer, &Thumbnailer::thumbnailReady,
+                      this->seeker, &Seeker::setThumbnail);
+    }
+    this->seeker->setSpan(first, count);
+    this->seeker->setCurrent(this->index1);
+    this->thumbnailer->request(this->seeker->missing(this->index1));
+}
+
+// Let the loader decode pages only as large as the window needs. Each page's
+// box depends on how it is laid out, which the loader works out from this.
+void CentralWidget::updateViewport()
+{
+    if (this->loader)
+        this->loader->setViewport(this->decodeToFit ? this->size() : QSize());
+}
+
 bool CentralWidget::event(QEvent *event)
 {
     if (event->type() == QEvent::Gesture)
@@ -122,6 +275,12 @@ void CentralWidget::keyPressEvent(QKeyEvent *event)
     case Qt::Key::Key_Escape:
         this->closeCurrentSession();
         break;
+    case Qt::Key::Key_F3:
+        this->setHudVisible(this->hud->isHidden());
+        break;
+    case Qt::Key::Key_G:
+        this->setSeekerVisible(this->seeker->isHidden());
+        break;
     default:
         break;
     }
@@ -149,22 +308,32 @@ void CentralWidget::mouseReleaseEvent(QMouseEvent *event)
 
 void CentralWidget::resizeEvent(QResizeEvent *)
 {
-    if (this->isVerticalMode())
-    {
-        if (!this->image2.isNull())
-        {
-            this->fCache.push(this->image2);
-            this->image2 = Image();
-        }
-    }
-    else if (!this->image1.isNull() && !this->image1.isHorizontal())
-    {
-        if (this->image2.isNull())
-            this->image2 = this->readNext();
-    }
+    int seekerHeight = this->seeker->preferredHeight();
+    this->seeker->setGeometry(0, this->height() - seekerHeight,
+                              this->width(), seekerHeight);
+
+    // Scale fast until the window settles. Smooth scales already underway are
+    // for an outdated size, so don't wait for them.
+    this->resizing = true;
+    this->scaleSerial++;
+    this->resizeTimer->start();
     this->refreshLabels();
 }
 
+// Anything that depends on the window size beyond scaling waits for the
+// window to settle, so a drag doesn't queue decodes for sizes it has already
+// moved past.
+void CentralWidget::settleSize()
+{
+    this->updateViewport();
+
+    // Pair the current pages again, since the mode may have changed. Don't
+    // do this while a page turn is pending so it is not lost.
+    if (!this->loadingStep && this->index1 >= 0)
+        this->showForward(this->index1);
+    this->renderScaled();
+}
+
 void CentralWidget::wheelEvent(QWheelEvent *event)
 {
     if (event->delta() < 0)     // Down.
@@ -197,12 +366,19 @@ void CentralWidget::handleTap(QTapGesture *)
 
 void CentralWidget::closeCurrentSession()
 {
-    delete this->iterator;
-    this->iterator = nullptr;
+    delete this->thumbnailer;
+    this->thumbnailer = nullptr;
+    this->seeker->clear();
 
-    this->fCache.clear();
-    this->bCache.clear();
+    delete this->loader;
+    this->loader = nullptr;
+    this->hudBytesRead = 0;
 
+    this->setLoading(0, 0);
+    this->turnTimer.invalidate();
+
+    this->index1 = NoPage;
+    this->index2 = NoPage;
     this->image1 = Image();
     this->image2 = Image();
 }
@@ -216,7 +392,12 @@ void CentralWidget::populateOpenableEntries(const QList<QFileInfo> &sources)
         // TODO: Maybe we should do per-component comparison?
         return lhs.absoluteFilePath() < rhs.absoluteFilePath();
     });
-    this->iterator = new EntryIterator(infos);
+    this->loader = new PageLoader(infos, this);
+    this->loader->setPrefetch(this->prefetchDepth, this->prefetchBudget);
+    this->loader->setCacheBudget(this->cacheBudget);
+    this->updateViewport();
+    this->connect(this->loader, &PageLoader::pageLoaded,
+                  this, &CentralWidget::receivePage);
 
     QMetaObject::invokeMethod(this, &CentralWidget::nextPage,
                               Qt::QueuedConnection);
@@ -224,104 +405,195 @@ void CentralWidget::populateOpenableEntries(const QList<QFileInfo> &sources)
 
 bool CentralWidget::nextPage()
 {
-    Image p;
+    return this->goToPage(std::max(this->index1, this->index2) + 1);
+}
 
-    // Read one image. If this fails, we are at the end of the session. Do
-    // nothing to stay on the last page.
-    p = this->readNext();
-    if (p.isNull())
+bool CentralWidget::previousPage()
+{
+    if (this->index1 < 0)
         return false;
+    this->startTurn();
+    bool shown = this->showBackward(this->index1 - 1);
+    if (!shown && !this->loadingStep)
+        this->turnTimer.invalidate();
+    return shown;
+}
 
-    QString currentName = this->iterator->currentName();
+// Show pages from the given one on, like turning forward to it.
+bool CentralWidget::goToPage(int index)
+{
+    this->startTurn();
+    bool shown = this->showForward(index);
+    if (!shown && !this->loadingStep)
+        this->turnTimer.invalidate();
+    return shown;
+}
 
-    if (!this->image1.isNull())
-        this->bCache.push(this->image1);
-    this->image1 = p;
+void CentralWidget::startTurn()
+{
+    this->turnTimer.start();
+    this->turnWaited = false;
+}
 
-    // Read another image in non-vertical mode, and if the current is not
-    // horizontal.
-    if (this->isVerticalMode() || p.isHorizontal())
-        p = Image();
+// Called once pages are on screen; does nothing if they are not shown for a
+// page turn (e.g. the window was resized).
+void CentralWidget::finishTurn()
+{
+    if (!this->turnTimer.isValid())
+        return;
+    this->lastTurnTime = this->turnTimer.nsecsElapsed();
+    this->turnTimer.invalidate();
+    if (this->turnWaited)
+        this->turnMisses++;
     else
-        p = this->readNext();
+        this->turnHits++;
+}
 
-    // If the the second read image is horizontal, that image needs to be on its
-    // own page. Show only one image on the current page, and keep the read
-    // horizontal image for the next.
-    if (p.isHorizontal())
+// Find the first decoded page from the given index, going in the direction of
+// step, skipping pages that failed to decode. Returns NoPage if we run out of
+// pages, or Loading if a page on the way is not decoded yet.
+int CentralWidget::findPage(int from, int step)
+{
+    if (!this->loader)
+        return NoPage;
+    for (int i = from; !this->loader->isPastEnd(i); i += step)
     {
-        this->fCache.push(p);
-        p = Image();
+        if (!this->loader->isLoaded(i))
+        {
+            this->loader->request(i);
+            return Loading;
+        }
+        if (!this->loader->page(i).isNull())
+            return i;
     }
+    return NoPage;
+}
 
-    if (!this->image2.isNull())
-        this->bCache.push(this->image2);
-    this->image2 = p;
+bool CentralWidget::showForward(int start)
+{
+    // If there are no more pages, we are at the end of the session. Do
+    // nothing to stay on the last page.
+    int first = this->findPage(start, 1);
+    if (first < 0)
+    {
+        this->setLoading(first == Loading ? 1 : 0, start);
+        return false;
+    }
 
-    this->refreshLabels();
+    // Show another page in non-vertical mode, and if the first is not
+    // horizontal.
+    int second = NoPage;
+    if (!this->isVerticalMode() && !this->loader->page(first).isHorizontal())
+    {
+        second = this->findPage(first + 1, 1);
+        if (second == Loading)
+        {
+            this->setLoading(1, start);
+            return false;
+        }
 
-    QString title = QString("%1 - %2")
-            .arg(qApp->applicationName())
-            .arg(currentName);
-    this->setWindowTitle(title);
+        // If the the second page is horizontal, it needs to be on its own
+        // page. Show only one page now, and keep the horizontal one for the
+        // next.
+        if (second >= 0 && this->loader->page(second).isHorizontal())
+            second = NoPage;
+    }
+
+    this->showPages(first, second);
     return true;
 }
 
-bool CentralWidget::previousPage()
+bool CentralWidget::showBackward(int end)
 {
-    if (this->bCache.isEmpty())
+    int last = this->findPage(end, -1);
+    if (last < 0)
+    {
+        this->setLoading(last == Loading ? -1 : 0, end);
         return false;
+    }
 
-    if (this->label2->pixmap())
-        this->fCache.push(*this->label2->pixmap());
-    if (this->label1->pixmap())
-        this->fCache.push(*this->label1->pixmap());
-
-    this->image1 = this->bCache.pop();
-    this->image2 = Image();
-
-    // We want another image (if there is one) in non-vertical mode, and if the
-    // current image is not horizontal...
-    if (this->bCache.size() && !this->isVerticalMode()
-            && !this->image1.isHorizontal())
+    // We want another page (if there is one) in non-vertical mode, and if the
+    // current page is not horizontal...
+    int first = NoPage;
+    if (!this->isVerticalMode() && !this->loader->page(last).isHorizontal())
     {
-        auto image = this->bCache.pop();
-        if (image.isHorizontal())
+        first = this->findPage(last - 1, -1);
+        if (first == Loading)
         {
-            // ... But not if the newly-loaded page is itself horizontal.
-            this->bCache.push(image);
-        }
-        else
-        {
-            this->image2 = this->image1;
-            this->image1 = image;
+            this->setLoading(-1, end);
+            return false;
         }
+
+        // ... But not if that page is itself horizontal.
+        if (first >= 0 && this->loader->page(first).isHorizontal())
+            first = NoPage;
     }
-    this->refreshLabels();
+
+    if (first >= 0)
+        this->showPages(first, last);
+    else
+        this->showPages(last, NoPage);
     return true;
 }
 
-Image CentralWidget::readNext()
+void CentralWidget::showPages(int first, int second)
+{
+    this->setLoading(0, 0);
+
+    this->index1 = first;
+    this->index2 = second;
+    this->image1 = this->loader->page(first);
+    this->image2 = second >= 0 ? this->loader->page(second) : Image();
+    this->loader->setPosition(first, second);
+
+    this->refreshLabels();
+    this->finishTurn();
+    if (this->seeker->isVisible())
+        this->updateSeeker();
+
+    QString title = QString("%1 - %2")
+            .arg(qApp->applicationName())
+            .arg(this->loader->name(first));
+    this->setWindowTitle(title);
+}
+
+// Remember a page turn that needs to wait for the loader, and show a busy
+// cursor until it happens.
+void CentralWidget::setLoading(int step, int from)
 {
-    if (this->fCache.size())
-        return this->fCache.pop();
-    if (!this->iterator)
-        return Image();
+    this->loadingStep = step;
+    this->loadingFrom = from;
+    if (step)
+    {
+        this->turnWaited = true;
+        this->setCursor(Qt::BusyCursor);
+    }
+    else
+    {
+        this->unsetCursor();
+    }
+}
 
-    QPixmap pixmap;
-    while (true)
+void CentralWidget::retryLoading()
+{
+    switch (this->loadingStep)
     {
-        QByteArray bytes = this->iterator->next();
-        if (bytes.isNull()) // No more to read.
-            break;
-        if (pixmap.loadFromData(bytes))
-            break;
+    case 1:
+        this->showForward(this->loadingFrom);
+        break;
+    case -1:
+        this->showBackward(this->loadingFrom);
+        break;
+    default:
+        break;
     }
-    return Image(pixmap);
 }
 
 void CentralWidget::refreshLabels()
 {
+    TRACE_SPAN("refreshLabels");
+    this->pendingScales.clear();
+
     QList<QLabel *> labels;
     labels.append(this->label1);
     labels.append(this->label2);
@@ -345,7 +617,11 @@ void CentralWidget::refreshLabels()
         if (image.isNull())
             label->clear();
         else
-            label->setPixmap(image.scaledToFit(w, h));
+        {
+            auto pixmap = this->scaled(image, w, h);
+            TRACE_SPAN("setPixmap");
+            label->setPixmap(pixmap);
+        }
         label->setVisible(!image.isNull());
     }
 
@@ -353,14 +629,116 @@ void CentralWidget::refreshLabels()
     // rotate if to view in maximum.
     if (this->isVerticalMode() && this->image1.isHorizontal())
     {
-        auto pixmap = this->image1.scaledToFit(h, w);
+        auto pixmap = this->scaled(this->image1, h, w);
         QMatrix matrix;
         matrix.rotate(90);
-        this->label1->setPixmap(pixmap.transformed(matrix));
+        pixmap = pixmap.transformed(matrix);
+        TRACE_SPAN("setPixmap");
+        this->label1->setPixmap(pixmap);
     }
 }
 
+// While resizing, scale fast, and note what to scale smoothly once resizing
+// stops. Pages already scaled smoothly to the size are used as they are.
+QPixmap CentralWidget::scaled(const Image &image, int w, int h)
+{
+    if (!this->resizing)
+        return image.scaledToFit(w, h);
+    if (!image.hasScaled(w, h))
+    {
+        PendingScale scale;
+        scale.image = image;
+        scale.w = w;
+        scale.h = h;
+        this->pendingScales.append(scale);
+    }
+    return image.scaledToFit(w, h, Qt::FastTransformation);
+}
+
+// The window has settled; scale what is on screen smoothly in the background.
+// The last refresh left exactly what it showed fast in pendingScales.
+void CentralWidget::renderScaled()
+{
+    this->scaleSerial++;
+    this->scalesPending = this->pendingScales.size();
+    for (const auto &scale : this->pendingScales)
+    {
+        this->scalePool.start(new ScaleJob(this, this->scaleSerial,
+                                           scale.image, scale.w, scale.h));
+    }
+    this->pendingScales.clear();
+    if (!this->scalesPending)
+        this->resizing = false;
+}
+
+// Results are kept with the image even if the window was resized again since,
+// but pages are only shown again once every scale for the settled size is in.
+void CentralWidget::receiveScaled(int serial, const Image &image, int w, int h,
+                                  const QImage &scaled)
+{
+    image.setScaled(w, h, scaled);
+    if (serial != this->scaleSerial || --this->scalesPending > 0)
+        return;
+    this->resizing = false;
+    this->refreshLabels();
+}
+
+// Pages on screen may be loaded again, larger, after the window grows. Show
+// those in place; anything else may be what a pending page turn waits for.
+void CentralWidget::receivePage(int index)
+{
+    if (this->loadingStep || index < 0
+            || (index != this->index1 && index != this->index2))
+    {
+        this->retryLoading();
+        return;
+    }
+    this->image1 = this->loader->page(this->index1);
+    if (this->index2 >= 0)
+        this->image2 = this->loader->page(this->index2);
+    this->refreshLabels();
+}
+
 bool CentralWidget::isVerticalMode() const
 {
     return this->width() < this->height();
 }
+
+void CentralWidget::updateHud()
+{
+    auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 1); };
+    auto mib = [](qint64 bytes) { return QString::number(bytes >> 20); };
+    auto budget = [&mib](qint64 bytes) {
+        return bytes > 0 ? mib(bytes) + " MiB" : QString("unlimited");
+    };
+
+    PageLoader::Stats stats;
+    if (this->loader)
+        stats = this->loader->stats();
+
+    // Read throughput since the last update.
+    double seconds = this->hudClock.restart() / 1e3;
+    qint64 bytesRead = qMax(stats.bytesRead - this->hudBytesRead,
+                            Q_INT64_C(0));
+    this->hudBytesRead = stats.bytesRead;
+    double rate = seconds > 0 ? bytesRead / seconds / (1 << 20) : 0;
+
+    QStringList lines;
+    lines << QString("turn      %1 ms, %2 hits, %3 misses")
+             .arg(ms(this->lastTurnTime)).arg(this->turnHits)
+             .arg(this->turnMisses);
+    lines << QString("decode    %1 ms last, %2 ms mean, %3 pages")
+             .arg(ms(stats.lastDecodeTime))
+             .arg(ms(stats.decoded ? stats.decodeTime / stats.decoded : 0))
+             .arg(stats.decoded);
+    lines << QString("cache     %1 MiB of %2, %3 pages, %4 evicted")
+             .arg(mib(stats.cachedBytes)).arg(budget(this->cacheBudget))
+             .arg(stats.cachedPages).arg(stats.evicted);
+    lines << QString("prefetch  %1 pages, %2, %3 scheduled")
+             .arg(this->prefetchDepth).arg(budget(this->prefetchBudget))
+             .arg(stats.scheduled);
+    lines << QString("read      %1 MiB/s, %2 MiB total")
+             .arg(rate, 0, 'f', 1).arg(mib(stats.bytesRead));
+    this->hud->setText(lines.join('\n'));
+    this->hud->adjustSize();
+}
@@ -1,14 +1,17 @@
 #ifndef CENTRALWIDGET_H
 #define CENTRALWIDGET_H
 
-#include <QStack>
+#include <QElapsedTimer>
+#include <QThreadPool>
 #include <QWidget>
 #include "image.h"
 
 class QFileInfo;
 class QLabel;
 class QTapGesture;
-class EntryIterator;
+class PageLoader;
+class Seeker;
+class Thumbnailer;
 
 class CentralWidget : public QWidget
 {
@@ -21,6 +24,12 @@ public:
     bool openLocalPaths(const QStringList &paths);
     bool openFiles(const QList<QFileInfo> &infos);
 
+    void setPrefetch(int depth, qint64 budget);
+    void setCacheBudget(qint64 budget);
+    void setDecodeToFit(bool enabled);
+    void setHudVisible(bool visible);
+    void setSeekerVisible(bool visible);
+
 protected:
     bool event(QEvent *event) override;
     void dragEnterEvent(QDragEnterEvent *event) override;
@@ -31,27 +40,92 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
 
 private:
+    class ScaleJob;
+
     void handleTap(QTapGesture *gesture);
     void closeCurrentSession();
     void populateOpenableEntries(const QList<QFileInfo> &infos);
     bool nextPage();
     bool previousPage();
+    bool goToPage(int index);
+
+    enum { NoPage = -1, Loading = -2 };
+
+    int findPage(int from, int step);
+    bool showForward(int start);
+    bool showBackward(int end);
+    void showPages(int first, int second);
+    void setLoading(int step, int from);
+    void retryLoading();
+    void receivePage(int index);
+    void updateViewport();
+    void updateSeeker();
 
-    Image readNext();
     void refreshLabels();
+    QPixmap scaled(const Image &image, int w, int h);
+    void settleSize();
+    void renderScaled();
+    void receiveScaled(int serial, const Image &image, int w, int h,
+                       const QImage &scaled);
     bool isVerticalMode() const;
 
-    EntryIterator *iterator;
+    void startTurn();
+    void finishTurn();
+    void updateHud();
+
+    PageLoader *loader;
+    int prefetchDepth;
+    qint64 prefetchBudget;
+    qint64 cacheBudget;
+    bool decodeToFit;
 
+    int index1;
+    int index2;
     Image image1;
     Image image2;
-    QStack<Image> fCache;
-    QStack<Image> bCache;
+
+    // Navigation waiting on the loader; step is 0 if nothing is pending.
+    int loadingStep;
+    int loadingFrom;
 
     QLabel *label1;
     QLabel *label2;
 
     QTimer *doubleTapTimer;
+
+    // Pages are scaled fast while the window is being resized, and smoothly
+    // in the background once it has not been resized for a while.
+    struct PendingScale
+    {
+        Image image;
+        int w;
+        int h;
+    };
+
+    QTimer *resizeTimer;
+    bool resizing;
+    QList<PendingScale> pendingScales;
+    int scaleSerial;
+    int scalesPending;
+    QThreadPool scalePool;
+
+    // The page turn underway, if any, and how turns went so far. A turn is a
+    // hit if its pages were already decoded.
+    QElapsedTimer turnTimer;
+    bool turnWaited;
+    qint64 lastTurnTime;
+    int turnHits;
+    int turnMisses;
+
+    // Performance overlay, toggled with F3.
+    QLabel *hud;
+    QTimer *hudTimer;
+    QElapsedTimer hudClock;
+    qint64 hudBytesRead;
+
+    // Page thumbnails to jump around with, toggled with G.
+    Thumbnailer *thumbnailer;
+    Seeker *seeker;
 };
 
 #endif // CENTRALWIDGET_H
@@ -1,17 +1,27 @@
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QDateTime>
 #include <QDirIterator>
 #include <QImageReader>
 #include <QMimeDatabase>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
 #ifdef Q_OS_WIN
 #include <Windows.h>
 #endif
 #include "zip/zip.h"
 #include "entryiterator.h"
+#include "trace.h"
+#include "verifiedarchives.h"
 
 static QMimeDatabase mdb;
 
 // This needs to be out-of-line to make Clang happy.
 // https://stackoverflow.com/questions/28786473
-EntryIterator::SubIterator::~SubIterator()
+EntryIterator::Container::~Container()
 {
 }
 
@@ -49,202 +59,753 @@ static zip_t *zip_open_unicode(const QFileInfo &info, int level, char mode)
 namespace
 {
 
-class ImageFileIterator : public EntryIterator::SubIterator
+// A buffer over page data, which keeps the data (and any mapping it points
+// into) alive with the buffer.
+class PageBuffer : public QBuffer
 {
 public:
-    ImageFileIterator(const QFileInfo &info) : info(info), done(false) {}
+    PageBuffer(const PageData &page) : page(page)
+    {
+        this->setData(page.bytes());
+        this->open(QIODevice::ReadOnly);
+    }
+
+private:
+    PageData page;
+};
 
-    QByteArray next()
+// Inflates an archive entry as it is read. The stream reads from the archive
+// mapping, which is kept alive with the device, so the archive itself can be
+// released meanwhile.
+class EntryStream : public QIODevice
+{
+public:
+    EntryStream(const QSharedPointer<QFile> &file, zip_entry_stream_t *stream) :
+        file(file), stream(stream),
+        remaining(static_cast<qint64>(zip_entry_stream_size(stream)))
     {
-        QByteArray data;
-        if (this->done)
-            return data;
-        QFile file(this->info.absoluteFilePath());
-        file.open(QIODevice::ReadOnly);
-        data = file.readAll();
-        file.close();
-        this->done = true;
-        return data;
+        this->open(QIODevice::ReadOnly);
+    }
+
+    ~EntryStream() override
+    {
+        zip_entry_stream_close(this->stream);
+    }
+
+    bool isSequential() const override { return true; }
+
+    qint64 bytesAvailable() const override
+    {
+        return this->remaining + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        auto size = zip_entry_stream_read(this->stream, data,
+                                          static_cast<size_t>(maxSize));
+        if (size < 0)
+            return -1;
+        this->remaining -= size;
+        return size;
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    QSharedPointer<QFile> file;
+    zip_entry_stream_t *stream;
+    qint64 remaining;
+};
+
+// Suffixes for each file type, built from the MIME database once. An image
+// or archive is any MIME type inheriting from what QImageReader or miniz
+// supports, same as matching the type of each file would.
+struct FileTypeTable
+{
+    FileTypeTable()
+    {
+        QList<QMimeType> imageTypes;
+        for (auto name : QImageReader::supportedMimeTypes())
+            imageTypes.append(mdb.mimeTypeForName(QString::fromLatin1(name)));
+
+        for (auto mime : mdb.allMimeTypes())
+        {
+            QSet<QString> *target = &this->others;
+            if (mime.inherits("application/zip"))
+            {
+                target = &this->archives;
+            }
+            else
+            {
+                for (auto imageType : imageTypes)
+                {
+                    if (mime.inherits(imageType.name()))
+                    {
+                        target = &this->images;
+                        break;
+                    }
+                }
+            }
+            for (auto suffix : mime.suffixes())
+                target->insert(suffix.toLower());
+        }
+
+        // A suffix claimed by multiple types is treated as the one we can
+        // open, e.g. if some MIME type also uses "zip".
+        this->others.subtract(this->images).subtract(this->archives);
     }
 
+    QSet<QString> images;
+    QSet<QString> archives;
+    QSet<QString> others;
+};
+
+// Classify a file by its content. This is only used for unknown suffixes.
+EntryIterator::FileType sniffFileType(const QFileInfo &info)
+{
+    QFile file(info.absoluteFilePath());
+    if (!file.open(QIODevice::ReadOnly))
+        return EntryIterator::Unsuppoerted;
+
+    // Local file header, or end of central directory for an empty archive.
+    auto magic = file.peek(4);
+    if (magic == "PK\x03\x04" || magic == "PK\x05\x06")
+        return EntryIterator::ZipArchive;
+    if (!QImageReader::imageFormat(&file).isEmpty())
+        return EntryIterator::Image;
+    return EntryIterator::Unsuppoerted;
+}
+
+class ImageFile : public EntryIterator::Container
+{
+public:
+    ImageFile(const QFileInfo &info) : info(info) {}
+
     QString name() const { return this->info.absoluteFilePath(); }
+    QString directory() const { return this->info.absolutePath(); }
+    int count() { return 1; }
+    qint64 size(int) const { return this->info.size(); }
+    void release() {}
+
+    // Map the file instead of reading it, so the decoder reads straight from
+    // the page cache, without a copy on the heap.
+    PageData read(int)
+    {
+        QSharedPointer<QFile> file(new QFile(this->info.absoluteFilePath()));
+        if (!file->open(QIODevice::ReadOnly))
+            return PageData();
+        auto size = file->size();
+        auto data = size > 0 ? file->map(0, size) : nullptr;
+        if (!data)
+            return PageData(file->readAll());
+        return PageData(file, data, size);
+    }
 
 private:
     QFileInfo info;
-    bool done;
 };
 
-class ZipArchiveIterator : public EntryIterator::SubIterator
+// Verification reads whole archives, one at a time, on a pool of its own so
+// it doesn't take threads from anything waiting on the global pool.
+static QThreadPool *verifyPool()
+{
+    static QThreadPool pool;
+    pool.setMaxThreadCount(1);
+    return &pool;
+}
+
+// Set to stop all verification, e.g. at exit.
+static QAtomicInt verifyCancelled;
+
+// Extracts every entry of an archive to check their CRC-32, and records the
+// archive as verified if they all match. This reads the whole archive, so it
+// runs in the background, with its own handle so reads are not held up.
+//
+// The job gives up between entries once no reader has the archive open, so
+// only archives being read are verified.
+class VerifyJob : public QRunnable
 {
 public:
-    ZipArchiveIterator(const QFileInfo &info) :
-        info(info), zip(zip_open_unicode(info, 0, 'r'))
+    VerifyJob(const QString &path, const QSharedPointer<QAtomicInt> &verified) :
+        path(path), verified(verified) {}
+
+    void run() override
     {
-        if (!this->zip)
+        QFileInfo info(this->path);
+        auto size = info.size();
+        auto modified = info.lastModified();
+
+        zip_t *zip = nullptr;
+        QFile file(this->path);
+        if (file.open(QIODevice::ReadOnly) && size > 0)
+        {
+            auto data = file.map(0, size);
+            if (data)
+            {
+                zip = zip_stream_open(reinterpret_cast<const char *>(data),
+                                      static_cast<size_t>(size), 0, 'r');
+            }
+        }
+        if (!zip)
+            zip = zip_open_unicode(info, 0, 'r');
+        if (!zip)
             return;
 
-        for (int i = 0; i < zip_total_entries(this->zip); i++)
+        bool ok = true;
+        for (int i = 0; ok && i < zip_total_entries(zip); i++)
         {
-            zip_entry_openbyindex(this->zip, i);
-            QString name = QString::fromLocal8Bit(zip_entry_name(this->zip));
-            this->entries.append(name);
+            if (this->isCancelled())
+            {
+                ok = false;
+                break;
+            }
+            ok = zip_entry_openbyindex(zip, i) >= 0
+                    && zip_entry_extract(zip, discard, nullptr) >= 0;
+            zip_entry_close(zip);
         }
-        // TODO: Maybe we should do per-component comparison?
-        std::sort(this->entries.begin(), this->entries.end());
-        this->iter = this->entries.cbegin();
+        zip_close(zip);
+
+        // Don't vouch for the file if it changed while we were reading it.
+        info.refresh();
+        if (!ok || info.size() != size || info.lastModified() != modified)
+            return;
+        VerifiedArchives::insert(info);
+        auto verified = this->verified.toStrongRef();
+        if (verified)
+            verified->storeRelease(1);
+    }
+
+private:
+    bool isCancelled() const
+    {
+        return verifyCancelled.loadAcquire() || !this->verified.toStrongRef();
     }
 
-    ~ZipArchiveIterator()
+    static size_t discard(void *, unsigned long long, const void *, size_t size)
     {
+        return size;
+    }
+
+    QString path;
+    QWeakPointer<QAtomicInt> verified;
+};
+
+// The archive is only opened when its entries are first needed, and can be
+// closed again with release(), to be reopened on the next read.
+//
+// Archives are mapped into memory when possible, so entries stored without
+// compression (most pages) can be handed to the decoder without a copy.
+//
+// Entries are checked against their CRC-32 until the whole archive has been
+// verified once; from then on, reads skip the check.
+//
+// Entries are read by index, without touching the zip handle, so several
+// threads can extract entries of a mapped archive at once. Each read keeps
+// its inflate state to itself.
+class ZipFile : public EntryIterator::Container
+{
+public:
+    ZipFile(const QFileInfo &info) :
+        info(info), zip(nullptr), listed(false), checkCrc(true),
+        verified(new QAtomicInt(0)), verifying(false)
+    {
+    }
+
+    ~ZipFile()
+    {
+        this->release();
+    }
+
+    QString name() const { return this->info.absoluteFilePath(); }
+
+    int count()
+    {
+        QWriteLocker locker(&this->lock);
+        if (!this->listed)
+            this->list();
+        return this->entries.size();
+    }
+
+    qint64 size(int entry) const { return this->entries[entry].size; }
+
+    void release()
+    {
+        QWriteLocker locker(&this->lock);
         if (this->zip)
             zip_close(this->zip);
+        this->zip = nullptr;
+
+        // Pages still being decoded keep their own reference to the mapping.
+        this->file.reset();
+
+        // Let go of a verification under way, which stops it if no one else
+        // reads the archive. It starts over if the archive is opened again.
+        if (!this->verified->loadAcquire())
+        {
+            this->verified.reset(new QAtomicInt(0));
+            this->verifying = false;
+        }
     }
 
-    QByteArray next()
+    PageData read(int entry)
     {
-        if (!this->zip || this->iter == this->entries.cend())
-            return QByteArray();
-        zip_entry_open(this->zip, (*this->iter).toLocal8Bit().constData());
-        auto bufsize = zip_entry_size(this->zip);
+        TRACE_SPAN("zip read");
+        QReadLocker locker(&this->lock);
+        if (!this->prepare(locker))
+            return PageData();
+
+        auto index = this->entries[entry].index;
+        const void *data;
+        if (this->file)
+        {
+            auto size = zip_entry_mapreadbyindex(this->zip, index, &data);
+            if (size >= 0)
+            {
+                return PageData(this->file, static_cast<const uchar *>(data),
+                                static_cast<qint64>(size));
+            }
+        }
+
+        // Archives read through stdio share a file position, so reads from
+        // them still need to take turns.
+        QMutexLocker serial(this->file ? nullptr : &this->stdioMutex);
+        auto bufsize = static_cast<size_t>(this->entries[entry].size);
         QByteArray bytes(static_cast<int>(bufsize), '\0');
-        zip_entry_noallocread(this->zip, bytes.data(), bufsize);
-        this->iter++;
+        if (zip_entry_noallocreadbyindex(this->zip, index, bytes.data(),
+                                         bufsize) < 0)
+            bytes = QByteArray();
         return bytes;
     }
 
-    QString name() const { return this->info.absoluteFilePath(); }
+    // Compressed entries of mapped archives are inflated as they are read,
+    // and stored ones are read from the mapping. Anything else is read in
+    // one go.
+    QIODevice *stream(int entry)
+    {
+        TRACE_SPAN("zip stream open");
+        {
+            QReadLocker locker(&this->lock);
+            if (!this->prepare(locker))
+                return nullptr;
 
-private:
-    QFileInfo info;
-    zip_t *zip;
-    QStringList entries;
-    QStringList::const_iterator iter;
-};
+            auto index = this->entries[entry].index;
+            const void *data;
+            if (this->file)
+            {
+                auto size = zip_entry_mapreadbyindex(this->zip, index, &data);
+                if (size >= 0)
+                {
+                    return new PageBuffer(PageData(
+                            this->file, static_cast<const uchar *>(data),
+                            static_cast<qint64>(size)));
+                }
+                auto stream = zip_entry_stream_open(this->zip, index);
+                if (stream)
+                    return new EntryStream(this->file, stream);
+            }
+        }
+        return Container::stream(entry);
+    }
 
-class DirectoryIterator : public EntryIterator::SubIterator
-{
-public:
-    DirectoryIterator(const QDir &dir)
+private:
+    // Reads share the handle; opening the archive or changing how it is read
+    // needs it to itself. Returns with the read lock held if reads can go
+    // ahead.
+    bool prepare(QReadLocker &locker)
     {
-        QDirIterator::IteratorFlags flags =
-                QDirIterator::Subdirectories | QDirIterator::FollowSymlinks;
-        QDirIterator diriter(dir, flags);
-        while (!diriter.next().isEmpty())
+        while (!this->isReady())
         {
-            auto info = diriter.fileInfo();
-            switch (EntryIterator::fileType(info))
+            locker.unlock();
             {
-            case EntryIterator::Unsuppoerted:
-            case EntryIterator::Directory:
-                break;
-            case EntryIterator::Image:
-                this->subs.append(new ImageFileIterator(info));
-                break;
-            case EntryIterator::ZipArchive:
-                this->subs.append(new ZipArchiveIterator(info));
-                break;
+                QWriteLocker writer(&this->lock);
+                if (!this->open())
+                    return false;
+                this->checkCrc = !this->verified->loadAcquire();
+                zip_set_crc_check(this->zip, this->checkCrc);
             }
+            locker.relock();
         }
-        std::sort(this->subs.begin(), this->subs.end(),
-                  [](SubIterator *a, SubIterator *b) {
-            // TODO: Sort paths by components instead of as string?
-            return a->name().compare(b->name(), Qt::CaseInsensitive) < 0;
-        });
+        return true;
     }
 
-    ~DirectoryIterator()
+    // Whether reads can go ahead with the handle as it is. Needs to be called
+    // with the lock held.
+    bool isReady() const
     {
-        for (auto sub : this->subs)
-            delete sub;
+        return this->zip && this->checkCrc == !this->verified->loadAcquire();
+    }
+
+    bool open()
+    {
+        if (this->zip)
+            return true;
+        TRACE_SPAN("zip open");
+        this->verify();
+
+        QSharedPointer<QFile> file(new QFile(this->info.absoluteFilePath()));
+        if (file->open(QIODevice::ReadOnly) && file->size() > 0)
+        {
+            auto data = file->map(0, file->size());
+            if (data)
+            {
+                this->zip = zip_stream_open(
+                            reinterpret_cast<const char *>(data),
+                            static_cast<size_t>(file->size()), 0, 'r');
+            }
+            if (this->zip)
+            {
+                this->file = file;
+                return true;
+            }
+        }
+
+        // Fall back to reading through stdio.
+        this->zip = zip_open_unicode(this->info, 0, 'r');
+        return this->zip != nullptr;
     }
 
-    QByteArray next()
+    // Look the archive up in the verified list, or verify it if it's not
+    // there. Containers of the same archive, e.g. in another iterator, share
+    // the verification, so each archive is only read through once.
+    void verify()
     {
-        while (this->subs.size())
+        if (this->verifying)
+            return;
+        this->verifying = true;
+        bool first;
+        this->verified = VerifiedArchives::claim(this->info, &first);
+        if (first)
         {
-            auto next = this->subs.first()->next();
-            if (!next.isNull())
-                return next;
-            delete this->subs.takeFirst();
+            verifyPool()->start(new VerifyJob(this->info.absoluteFilePath(),
+                                              this->verified));
         }
-        return QByteArray();
     }
 
-    QString name() const
+    void list()
     {
-        if (this->subs.isEmpty())
-            return QString();
-        return this->subs.first()->name();
+        this->listed = true;
+        if (!this->open())
+            return;
+        TRACE_SPAN("zip list");
+
+        // Remember each entry's index, so reads don't need to look up entries
+        // by name. Lookups are linear scans since we ask miniz not to sort the
+        // central directory.
+        for (int i = 0; i < zip_total_entries(this->zip); i++)
+        {
+            if (zip_entry_openbyindex(this->zip, i) < 0)
+                continue;
+            if (zip_entry_isdir(this->zip) == 0)
+            {
+                Entry entry;
+                entry.name = QString::fromLocal8Bit(zip_entry_name(this->zip));
+                entry.index = i;
+                entry.size = static_cast<qint64>(zip_entry_size(this->zip));
+                this->entries.append(entry);
+            }
+            zip_entry_close(this->zip);
+        }
+        // TODO: Maybe we should do per-component comparison?
+        std::sort(this->entries.begin(), this->entries.end(),
+                  [](const Entry &a, const Entry &b) {
+            return a.name < b.name;
+        });
     }
 
-private:
-    QList<SubIterator *> subs;
+    struct Entry
+    {
+        QString name;
+        int index;
+        qint64 size;
+    };
+
+    QFileInfo info;
+    QSharedPointer<QFile> file;
+    zip_t *zip;
+    bool listed;
+    QVector<Entry> entries;
+    QReadWriteLock lock;
+    QMutex stdioMutex;
+    bool checkCrc;
+
+    // Shared with the verification job, which may outlive the container.
+    QSharedPointer<QAtomicInt> verified;
+    bool verifying;
 };
 
+QList<EntryIterator::Container *> listDirectory(const QDir &dir)
+{
+    QList<EntryIterator::Container *> containers;
+    QDirIterator::IteratorFlags flags =
+            QDirIterator::Subdirectories | QDirIterator::FollowSymlinks;
+    QDirIterator diriter(dir, flags);
+    while (!diriter.next().isEmpty())
+    {
+        auto info = diriter.fileInfo();
+        switch (EntryIterator::fileType(info))
+        {
+        case EntryIterator::Unsuppoerted:
+        case EntryIterator::Directory:
+            break;
+        case EntryIterator::Image:
+            containers.append(new ImageFile(info));
+            break;
+        case EntryIterator::ZipArchive:
+            containers.append(new ZipFile(info));
+            break;
+        }
+    }
+    std::sort(containers.begin(), containers.end(),
+              [](EntryIterator::Container *a, EntryIterator::Container *b) {
+        // TODO: Sort paths by components instead of as string?
+        return a->name().compare(b->name(), Qt::CaseInsensitive) < 0;
+    });
+    return containers;
+}
+
 }   // (anonymous namespace)
 
-EntryIterator::EntryIterator(const QList<QFileInfo> &infos) : infos(infos)
+QIODevice *EntryIterator::Container::stream(int entry)
 {
-    this->cur = this->infos.cbegin();
+    auto page = this->read(entry);
+    if (page.isNull())
+        return nullptr;
+    return new PageBuffer(page);
+}
+
+EntryIterator::EntryIterator(const QList<QFileInfo> &infos) :
+    listed(0), listing(false)
+{
+    for (auto info : infos)
+    {
+        switch (fileType(info))
+        {
+        case Unsuppoerted:
+            break;
+        case Directory:
+            this->containers.append(
+                        listDirectory(QDir(info.absoluteFilePath())));
+            break;
+        case Image:
+            this->containers.append(new ImageFile(info));
+            break;
+        case ZipArchive:
+            this->containers.append(new ZipFile(info));
+            break;
+        }
+    }
+}
+
+EntryIterator::~EntryIterator()
+{
+    for (auto container : this->containers)
+        delete container;
 }
 
 EntryIterator::FileType EntryIterator::fileType(const QFileInfo &info)
 {
     if (info.isDir())
         return Directory;
-    auto mime = mdb.mimeTypeForFile(info);
-    if (mime.inherits("application/zip"))
+
+    // Most files can be classified by suffix alone. Only look into the file
+    // if the suffix is not known at all.
+    static const FileTypeTable table;
+    auto suffix = info.suffix().toLower();
+    if (table.images.contains(suffix))
+        return Image;
+    if (table.archives.contains(suffix))
         return ZipArchive;
-    for (auto name : QImageReader::supportedMimeTypes())
-    {
-        if (mime.inherits(QString::fromLocal8Bit(name)))
-            return Image;
-    }
-    return Unsuppoerted;
+    if (table.others.contains(suffix))
+        return Unsuppoerted;
+    return sniffFileType(info);
+}
+
+void EntryIterator::waitForVerification()
+{
+    verifyPool()->waitForDone();
 }
 
-QByteArray EntryIterator::next()
+void EntryIterator::cancelVerification()
 {
-    while (true)
+    verifyCancelled.storeRelease(1);
+    verifyPool()->clear();
+}
+
+// Whether pages of the two containers go together: they are the same archive,
+// or images in the same directory.
+static bool isSameSpan(EntryIterator::Container *a,
+                       EntryIterator::Container *b)
+{
+    if (a == b)
+        return true;
+    auto imageA = dynamic_cast<ImageFile *>(a);
+    auto imageB = dynamic_cast<ImageFile *>(b);
+    return imageA && imageB && imageA->directory() == imageB->directory();
+}
+
+// List pages from containers until the page at index is known, or all
+// containers are listed. Needs to be called with the mutex held by locker.
+//
+// Listing an archive parses its whole central directory, so the mutex is let
+// go meanwhile, and pages already listed can be read. Containers are listed
+// one at a time, in order; other threads that need more pages wait for it.
+bool EntryIterator::list(int index, QMutexLocker &locker)
+{
+    while (index >= this->pages.size()
+           && this->listed < this->containers.size())
     {
-        // Try the current subiterator.
-        QByteArray bytes;
-        if (this->iter)
+        if (this->listing)
         {
-            bytes = this->iter->next();
-            if (!bytes.isNull())
-                return bytes;
+            this->listedCondition.wait(&this->mutex);
+            continue;
         }
+        this->listing = true;
+        auto container = this->containers[this->listed];
 
-        // The current subiterator is finished. Try to move to next entry.
+        locker.unlock();
+        QVector<Page> pages(container->count());
+        for (int i = 0; i < pages.size(); i++)
+        {
+            pages[i].container = container;
+            pages[i].entry = i;
+            pages[i].size = container->size(i);
+        }
+        locker.relock();
 
-        // No more to read. Give up.
-        if (this->cur == this->infos.cend())
-            return bytes;
+        this->pages += pages;
+        this->listed++;
+        this->listing = false;
+        this->touch(container);
+        this->listedCondition.wakeAll();
+    }
+    return index >= 0 && index < this->pages.size();
+}
 
-        // Open a new one to read.
-        SubIterator *next;
-        auto info = *this->cur;
-        switch (fileType(info))
-        {
-        case Unsuppoerted:
-            return bytes;
-        case Directory:
-            next = new DirectoryIterator(QDir(info.absoluteFilePath()));
-            break;
-        case Image:
-            next = new ImageFileIterator(info);
-            break;
-        case ZipArchive:
-            next = new ZipArchiveIterator(info);
+// Keep track of recently used containers. Ones not used for a while are
+// queued to be released. Needs to be called with the mutex held.
+void EntryIterator::touch(Container *container)
+{
+    this->recent.removeOne(container);
+    this->recent.prepend(container);
+    while (this->recent.size() > OpenContainerLimit)
+        this->stale.append(this->recent.takeLast());
+}
+
+// Close archives the reader has moved away from. This needs to be called
+// without the mutex held, since it may wait for a read to finish.
+void EntryIterator::releaseStale()
+{
+    QList<Container *> stale;
+    {
+        QMutexLocker locker(&this->mutex);
+        stale.swap(this->stale);
+    }
+    for (auto container : stale)
+        container->release();
+}
+
+int EntryIterator::count() const
+{
+    QMutexLocker locker(&this->mutex);
+    return this->pages.size();
+}
+
+bool EntryIterator::isComplete() const
+{
+    QMutexLocker locker(&this->mutex);
+    return this->listed >= this->containers.size();
+}
+
+qint64 EntryIterator::sizeAt(int index)
+{
+    qint64 size = 0;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (this->list(index, locker))
+            size = this->pages[index].size;
+    }
+    this->releaseStale();
+    return size;
+}
+
+QString EntryIterator::nameAt(int index)
+{
+    QString name;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (this->list(index, locker))
+            name = this->pages[index].container->name();
+    }
+    this->releaseStale();
+    return name;
+}
+
+// The page's position in its container, e.g. its index in an archive. -1 if
+// there is no such page.
+int EntryIterator::entryAt(int index)
+{
+    int entry = -1;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (this->list(index, locker))
+            entry = this->pages[index].entry;
+    }
+    this->releaseStale();
+    return entry;
+}
+
+PageData EntryIterator::pageAt(int index)
+{
+    Page page;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (!this->list(index, locker))
+            return PageData();
+        page = this->pages[index];
+        this->touch(page.container);
+    }
+    this->releaseStale();
+    return page.container->read(page.entry);
+}
+
+// Images are listed forward until the directory changes, which is cheap; the
+// next archive is not opened to find where the span ends.
+bool EntryIterator::span(int index, int *first, int *count)
+{
+    QMutexLocker locker(&this->mutex);
+    if (!this->list(index, locker))
+        return false;
+    auto container = this->pages[index].container;
+    int begin = index;
+    while (begin > 0
+           && isSameSpan(this->pages[begin - 1].container, container))
+        begin--;
+    int end = index + 1;
+    while (end < this->pages.size()
+           || (this->listed < this->containers.size()
+               && isSameSpan(this->containers[this->listed], container)
+               && this->list(end, locker)))
+    {
+        if (!isSameSpan(this->pages[end].container, container))
             break;
-        }
-        this->iter.reset(next);
-        this->cur++;
+        end++;
     }
+    *first = begin;
+    *count = end - begin;
+    return true;
 }
 
-QString EntryIterator::currentName() const
+QIODevice *EntryIterator::streamAt(int index)
 {
-    return this->iter->name();
+    Page page;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (!this->list(index, locker))
+            return nullptr;
+        page = this->pages[index];
+        this->touch(page.container);
+    }
+    this->releaseStale();
+    return page.container->stream(page.entry);
 }
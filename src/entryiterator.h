@@ -1,16 +1,43 @@
 #ifndef ENTRYITERATOR_H
 #define ENTRYITERATOR_H
 
+#include <QByteArray>
 #include <QList>
-#include <QScopedPointer>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+#include <QWaitCondition>
 
+class QFile;
 class QFileInfo;
+class QIODevice;
 struct zip_t;
 
+// Bytes of a page. These may point into a file mapping, which is kept alive
+// for as long as any copy of the page data is around.
+class PageData
+{
+public:
+    PageData() {}
+    PageData(const QByteArray &bytes) : data(bytes) {}
+    PageData(const QSharedPointer<QFile> &file, const uchar *data, qint64 size) :
+        data(QByteArray::fromRawData(reinterpret_cast<const char *>(data),
+                                     static_cast<int>(size))),
+        file(file) {}
+
+    const QByteArray &bytes() const { return this->data; }
+    bool isNull() const { return this->data.isNull(); }
+
+private:
+    QByteArray data;
+    QSharedPointer<QFile> file;
+};
+
 class EntryIterator
 {
 public:
     explicit EntryIterator(const QList<QFileInfo> &infos);
+    ~EntryIterator();
 
     enum FileType
     {
@@ -20,15 +47,36 @@ public:
         ZipArchive,
     };
 
-    struct SubIterator
+    // A file holding pages, i.e. an image file or an archive. Containers are
+    // cheap until count() is first called. Reads may come from multiple
+    // threads; release() frees resources held between reads.
+    struct Container
     {
-        virtual ~SubIterator();
-        virtual QByteArray next() = 0;
+        virtual ~Container();
         virtual QString name() const = 0;
+        virtual int count() = 0;
+        virtual qint64 size(int entry) const = 0;
+        virtual PageData read(int entry) = 0;
+        virtual void release() = 0;
+
+        // Opens the entry to be read as it is extracted, so decoding can start
+        // before the whole entry is in memory. By default the entry is read in
+        // full first. Returns nullptr if the entry can't be read; the caller
+        // owns the device.
+        virtual QIODevice *stream(int entry);
     };
 
     static FileType fileType(const QFileInfo &info);
 
+    // Archives are verified in the background when first opened; this waits
+    // for every verification started so far.
+    static void waitForVerification();
+
+    // Stops verification for good, e.g. before exiting, so the process
+    // doesn't wait for archives to be read through. Archives not verified
+    // yet are verified the next time they are opened.
+    static void cancelVerification();
+
     inline static bool isValidEntry(const QFileInfo &info)
     { return fileType(info) != FileType::Unsuppoerted; }
 
@@ -38,13 +86,47 @@ public:
     inline static bool isZipArchive(const QFileInfo &info)
     { return fileType(info) == FileType::ZipArchive; }
 
-    QByteArray next();
-    QString currentName() const;
+    // Pages are listed lazily as they are accessed, so count() only includes
+    // pages listed so far until isComplete() is true.
+    int count() const;
+    bool isComplete() const;
+
+    qint64 sizeAt(int index);
+    QString nameAt(int index);
+    int entryAt(int index);
+    PageData pageAt(int index);
+    QIODevice *streamAt(int index);
+
+    // Finds the pages that go with the page at index: those of its archive,
+    // or the loose images in its directory. Returns false if there is no such
+    // page.
+    bool span(int index, int *first, int *count);
 
 private:
-    QList<QFileInfo> infos;
-    QList<QFileInfo>::const_iterator cur;
-    QScopedPointer<SubIterator> iter;
+    Q_DISABLE_COPY(EntryIterator)
+
+    // Number of recently read containers to keep open.
+    static const int OpenContainerLimit = 3;
+
+    struct Page
+    {
+        Container *container;
+        int entry;
+        qint64 size;
+    };
+
+    bool list(int index, QMutexLocker &locker);
+    void touch(Container *container);
+    void releaseStale();
+
+    mutable QMutex mutex;
+    QList<Container *> containers;
+    int listed;
+    bool listing;
+    QWaitCondition listedCondition;
+    QVector<Page> pages;
+    QList<Container *> recent;
+    QList<Container *> stale;
 };
 
 #endif // ENTRYITERATOR_H
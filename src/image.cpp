@@ -1,19 +1,124 @@
 #include "image.h"
+#include "resample.h"
+#include "trace.h"
 
-Image::Image(const QPixmap &pixmap) : orig(pixmap)
+// Halves the image with a 2x2 box filter. Bytes are averaged separately, which
+// is right for grayscale and premultiplied colors; anything else is converted
+// to one of those first.
+static QImage halved(const QImage &image)
 {
+    QImage source = image;
+    switch (source.format())
+    {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        break;
+    default:
+        if (source.isGrayscale() && !source.hasAlphaChannel())
+            source = source.convertToFormat(QImage::Format_Grayscale8);
+        else if (source.hasAlphaChannel())
+            source = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        else
+            source = source.convertToFormat(QImage::Format_RGB32);
+        break;
+    }
+
+    int bpp = source.depth() / 8;
+    int w = source.width() / 2;
+    int h = source.height() / 2;
+    QImage result(w, h, source.format());
+    for (int y = 0; y < h; y++)
+    {
+        const uchar *row0 = source.constScanLine(2 * y);
+        const uchar *row1 = source.constScanLine(2 * y + 1);
+        uchar *out = result.scanLine(y);
+        for (int x = 0; x < w; x++)
+        {
+            for (int c = 0; c < bpp; c++)
+            {
+                int sum = row0[c] + row0[c + bpp] + row1[c] + row1[c + bpp];
+                out[c] = static_cast<uchar>((sum + 2) / 4);
+            }
+            row0 += 2 * bpp;
+            row1 += 2 * bpp;
+            out += bpp;
+        }
+    }
+    return result;
 }
 
-const QPixmap &Image::original() const
+Image::Image(const QImage &image) :
+    orig(image), renditions(new QList<Rendition>)
+{
+}
+
+const QImage &Image::original() const
 {
     return this->orig;
 }
 
-QPixmap Image::scaledToFit(int w, int h) const
+// This takes a while for large pages, so do it before the image is handed to
+// the GUI thread.
+void Image::buildMipmaps()
+{
+    this->mipmaps.clear();
+    const QImage *level = &this->orig;
+    while (level->width() >= MipmapMinimum * 2
+           && level->height() >= MipmapMinimum * 2)
+    {
+        this->mipmaps.append(halved(*level));
+        level = &this->mipmaps.last();
+    }
+}
+
+// Scale the image before converting it, so only the pixels actually shown are
+// turned into a pixmap. Fast scaling is for transient states, e.g. while the
+// window is being resized, so it is not kept, but uses a smooth rendition if
+// there is one.
+QPixmap Image::scaledToFit(int w, int h, Qt::TransformationMode mode) const
+{
+    TRACE_SPAN("scaledToFit");
+    int index = this->findRendition(w, h);
+    if (index >= 0)
+    {
+        this->renditions->move(index, 0);
+        return this->renditions->first().pixmap;
+    }
+
+    if (mode == Qt::FastTransformation)
+    {
+        auto &source = this->sourceToFit(w, h);
+        if (this->fitsToHeight(w, h))
+            return QPixmap::fromImage(source.scaledToHeight(h, mode));
+        return QPixmap::fromImage(source.scaledToWidth(w, mode));
+    }
+    return this->addRendition(w, h, this->renderToFit(w, h));
+}
+
+bool Image::hasScaled(int w, int h) const
+{
+    return this->findRendition(w, h) >= 0;
+}
+
+// Qt's smooth scaling is bilinear, which skips pixels when shrinking by more
+// than half; resample with a proper filter instead.
+QImage Image::renderToFit(int w, int h) const
 {
-    if ((1.0 * w / h) > (1.0 * this->orig.width() / this->orig.height()))
-        return this->orig.scaledToHeight(h, Qt::SmoothTransformation);
-    return this->orig.scaledToWidth(w, Qt::SmoothTransformation);
+    TRACE_SPAN("resample");
+    auto &source = this->sourceToFit(w, h);
+    auto &orig = this->orig;
+    if (this->fitsToHeight(w, h))
+        w = qMax(qRound(1.0 * orig.width() * h / orig.height()), 1);
+    else
+        h = qMax(qRound(1.0 * orig.height() * w / orig.width()), 1);
+    return resampled(source, w, h);
+}
+
+void Image::setScaled(int w, int h, const QImage &scaled) const
+{
+    if (!this->hasScaled(w, h))
+        this->addRendition(w, h, scaled);
 }
 
 bool Image::isNull() const
@@ -27,3 +132,70 @@ bool Image::isHorizontal() const
         return false;
     return (this->orig.width() > this->orig.height());
 }
+
+// Scaled pixmaps count too; they can be as large as the page itself. Like
+// everything to do with pixmaps, this is for the GUI thread only.
+qint64 Image::sizeInBytes() const
+{
+    qint64 size = this->orig.sizeInBytes();
+    for (const auto &level : this->mipmaps)
+        size += level.sizeInBytes();
+    for (const auto &rendition : *this->renditions)
+    {
+        const auto &pixmap = rendition.pixmap;
+        size += static_cast<qint64>(pixmap.width()) * pixmap.height()
+                * pixmap.depth() / 8;
+    }
+    return size;
+}
+
+bool Image::fitsToHeight(int w, int h) const
+{
+    return (1.0 * w / h) > (1.0 * this->orig.width() / this->orig.height());
+}
+
+// The smallest level still at least as large as the target, in the side the
+// image is fitted to.
+const QImage &Image::sourceToFit(int w, int h) const
+{
+    bool toHeight = this->fitsToHeight(w, h);
+    const QImage *source = &this->orig;
+    for (const auto &level : this->mipmaps)
+    {
+        if ((toHeight ? level.height() < h : level.width() < w))
+            break;
+        source = &level;
+    }
+    return *source;
+}
+
+// Renditions are keyed by the side the image is fitted to, so viewports that
+// only differ in the other side share them.
+QSize Image::renditionKey(int w, int h) const
+{
+    return this->fitsToHeight(w, h) ? QSize(0, h) : QSize(w, 0);
+}
+
+int Image::findRendition(int w, int h) const
+{
+    auto key = this->renditionKey(w, h);
+    for (int i = 0; i < this->renditions->size(); i++)
+    {
+        if (this->renditions->at(i).size == key)
+            return i;
+    }
+    return -1;
+}
+
+const QPixmap &Image::addRendition(int w, int h, const QImage &scaled) const
+{
+    Rendition rendition;
+    rendition.size = this->renditionKey(w, h);
+    rendition.pixmap = QPixmap::fromImage(scaled);
+
+    auto &renditions = *this->renditions;
+    renditions.prepend(rendition);
+    while (renditions.size() > RenditionLimit)
+        renditions.removeLast();
+    return renditions.first().pixmap;
+}
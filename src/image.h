@@ -1,21 +1,65 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <QImage>
+#include <QList>
 #include <QPixmap>
+#include <QSharedPointer>
+#include <QVector>
 
+// A decoded page. The pixels are kept as a QImage, which can be created and
+// passed around on any thread; pixmaps are only made on the GUI thread, at
+// the size the page is shown.
+//
+// The last few smoothly scaled pixmaps are kept, and shared between copies of
+// the image, so showing a page again at the same size does not scale it
+// again.
+//
+// Images can also carry a chain of half-size copies, built once off the GUI
+// thread. Scaling then starts from the smallest copy still larger than the
+// target, instead of the full-size image.
 class Image
 {
 public:
-    Image(const QPixmap &pixmap = QPixmap());
+    Image(const QImage &image = QImage());
 
-    const QPixmap &original() const;
-    QPixmap scaledToFit(int w, int h) const;
+    const QImage &original() const;
+    void buildMipmaps();
+    QPixmap scaledToFit(int w, int h, Qt::TransformationMode mode =
+                        Qt::SmoothTransformation) const;
+
+    // Smooth scaling can be done ahead, off the GUI thread: renderToFit() is
+    // safe to call from any thread, and its result is kept with setScaled().
+    bool hasScaled(int w, int h) const;
+    QImage renderToFit(int w, int h) const;
+    void setScaled(int w, int h, const QImage &scaled) const;
 
     bool isNull() const;
     bool isHorizontal() const;
+    qint64 sizeInBytes() const;
 
 private:
-    QPixmap orig;
+    // Half-size copies are made down to this size, in either side.
+    static const int MipmapMinimum = 256;
+
+    // Number of scaled pixmaps to keep per image.
+    static const int RenditionLimit = 3;
+
+    struct Rendition
+    {
+        QSize size;
+        QPixmap pixmap;
+    };
+
+    bool fitsToHeight(int w, int h) const;
+    const QImage &sourceToFit(int w, int h) const;
+    QSize renditionKey(int w, int h) const;
+    int findRendition(int w, int h) const;
+    const QPixmap &addRendition(int w, int h, const QImage &scaled) const;
+
+    QImage orig;
+    QVector<QImage> mipmaps;
+    QSharedPointer<QList<Rendition>> renditions;
 };
 
 #endif // IMAGE_H
@@ -19,19 +19,43 @@ RC_ICONS = ../assets/bubble.ico
 SOURCES += \
     main.cpp \
     zip/zip.c \
+    zip/fastinflate.c \
     centralwidget.cpp \
     entryiterator.cpp \
-    image.cpp
+    image.cpp \
+    pageloader.cpp \
+    resample.cpp \
+    seeker.cpp \
+    thumbnailcache.cpp \
+    thumbnailer.cpp \
+    trace.cpp \
+    verifiedarchives.cpp
 
 HEADERS += \
     zip/miniz.h \
     zip/zip.h \
+    zip/fastinflate.h \
     centralwidget.h \
     entryiterator.h \
-    image.h
+    image.h \
+    pageloader.h \
+    resample.h \
+    seeker.h \
+    thumbnailcache.h \
+    thumbnailer.h \
+    trace.h \
+    verifiedarchives.h
 
 FORMS +=
 
+# Inflate archive entries with zip/fastinflate.c. Build with
+# "qmake CONFIG+=miniz_inflate" to use miniz's inflater instead.
+!miniz_inflate: DEFINES += ZIP_FAST_INFLATE
+
+# Trace spans cost a branch each until tracing is started with --trace. Build
+# with "qmake CONFIG+=no_trace" to leave them out.
+no_trace: DEFINES += KOMIQ_NO_TRACE
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
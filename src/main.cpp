@@ -1,6 +1,8 @@
 #include <QApplication>
 #include <QCommandLineParser>
 #include "centralwidget.h"
+#include "entryiterator.h"
+#include "trace.h"
 
 int main(int argc, char *argv[])
 {
@@ -9,11 +11,47 @@ int main(int argc, char *argv[])
 
     QCommandLineParser parser;
     parser.addPositionalArgument("files", "file to open", "[file ...]");
+    QCommandLineOption prefetchOption(
+                "prefetch", "number of pages to read ahead", "pages", "8");
+    parser.addOption(prefetchOption);
+    QCommandLineOption prefetchBudgetOption(
+                "prefetch-budget",
+                "memory for pages read ahead, in MiB (0 for no limit)",
+                "size", "512");
+    parser.addOption(prefetchBudgetOption);
+    QCommandLineOption cacheBudgetOption(
+                "cache-budget",
+                "memory for decoded pages, in MiB (0 for no limit)",
+                "size", "1024");
+    parser.addOption(cacheBudgetOption);
+    QCommandLineOption fullDecodeOption(
+                "full-decode",
+                "decode pages at full size, not just as large as the window");
+    parser.addOption(fullDecodeOption);
+    QCommandLineOption hudOption(
+                "hud", "show performance figures over the pages (F3)");
+    parser.addOption(hudOption);
+    QCommandLineOption traceOption(
+                "trace",
+                "record a Chrome trace of the page pipeline to file "
+                "(or set KOMIQ_TRACE)", "file");
+    parser.addOption(traceOption);
     parser.process(a);
 
     QStringList paths = parser.positionalArguments();
 
+    QString tracePath = parser.isSet(traceOption)
+            ? parser.value(traceOption)
+            : QString::fromLocal8Bit(qgetenv("KOMIQ_TRACE"));
+    if (!tracePath.isEmpty())
+        Trace::start();
+
     CentralWidget w;
+    w.setPrefetch(parser.value(prefetchOption).toInt(),
+                  parser.value(prefetchBudgetOption).toLongLong() << 20);
+    w.setCacheBudget(parser.value(cacheBudgetOption).toLongLong() << 20);
+    w.setDecodeToFit(!parser.isSet(fullDecodeOption));
+    w.setHudVisible(parser.isSet(hudOption));
     w.showMaximized();
 
     if (paths.size() > 0)
@@ -23,5 +61,9 @@ int main(int argc, char *argv[])
         }, Qt::QueuedConnection);
     }
 
-    return a.exec();
+    int code = a.exec();
+    EntryIterator::cancelVerification();
+    if (!tracePath.isEmpty() && !Trace::write(tracePath))
+        qWarning("cannot write trace to %s", qPrintable(tracePath));
+    return code;
 }
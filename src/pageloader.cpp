@@ -0,0 +1,499 @@
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QMutex>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QtMath>
+#include "entryiterator.h"
+#include "pageloader.h"
+#include "trace.h"
+
+// The smallest size a page can be shown at in the viewport without being
+// scaled up. The full size if there's no viewport.
+//
+// Pages are fitted to the whole viewport when shown alone, and to half its
+// width when paired; the whole viewport is the larger box. In a vertical
+// viewport, horizontal pages are turned to fill it.
+static QSize coveringSize(const QSize &full, const QSize &viewport)
+{
+    if (!viewport.isValid() || full.isEmpty())
+        return full;
+    QSize box = viewport;
+    if (viewport.width() < viewport.height()
+            && full.width() > full.height())
+        box.transpose();
+    double scale = qMin(qMin(1.0 * box.width() / full.width(),
+                             1.0 * box.height() / full.height()), 1.0);
+    return QSize(qCeil(full.width() * scale), qCeil(full.height() * scale));
+}
+
+// The smallest size libjpeg can decode at by itself (1/2, 1/4 or 1/8) that
+// still covers the viewport. Sizes are rounded down, so Qt picks the factor
+// we mean; libjpeg may round up, and Qt scales that last pixel away.
+static QSize reducedSize(const QSize &full, const QSize &viewport)
+{
+    QSize needed = coveringSize(full, viewport);
+    for (int factor = 8; factor > 1; factor /= 2)
+    {
+        QSize size(full.width() / factor, full.height() / factor);
+        if (!size.isEmpty() && size.width() >= needed.width()
+                && size.height() >= needed.height())
+            return size;
+    }
+    return full;
+}
+
+// Decodes an image, only as large as the viewport needs if the format can
+// decode at a smaller size. Others are decoded at full size, since Qt would
+// only scale them after decoding anyway.
+static QImage decode(QIODevice *device, const QSize &viewport, QSize *fullSize)
+{
+    TRACE_SPAN("decode");
+    QImageReader reader(device);
+    *fullSize = reader.size();
+    if (fullSize->isValid()
+            && reader.supportsOption(QImageIOHandler::ScaledSize))
+    {
+        QSize size = reducedSize(*fullSize, viewport);
+        if (size != *fullSize)
+            reader.setScaledSize(size);
+    }
+    QImage image = reader.read();
+    if (!fullSize->isValid())
+        *fullSize = image.size();
+    return image;
+}
+
+// Decoders may stop before the end of the data, e.g. at a JPEG's end marker.
+// Read the rest of a stream, so an archive entry is still checked against its
+// CRC-32 as a whole.
+static bool readToEnd(QIODevice *device)
+{
+    char buffer[4096];
+    qint64 size;
+    do
+    {
+        size = device->read(buffer, sizeof(buffer));
+    }
+    while (size > 0);
+    return size == 0;
+}
+
+struct PageLoader::Source
+{
+    Source(const QList<QFileInfo> &infos) : infos(infos) {}
+
+    QList<QFileInfo> infos;
+
+    // Set once by the index job, and only read from afterwards.
+    QScopedPointer<EntryIterator> iterator;
+
+    // Pages scheduled but not yet started. A job whose page has been taken
+    // out of this does nothing; this is how queued reads are cancelled.
+    QMutex mutex;
+    QSet<int> queued;
+};
+
+// Finds pages from the sources. This walks directories, so it is done off the
+// GUI thread as well. Archives are only listed when pages in them are read.
+class PageLoader::IndexJob : public QRunnable
+{
+public:
+    IndexJob(PageLoader *loader, Source *source) :
+        loader(loader), source(source) {}
+
+    void run() override
+    {
+        PageLoader *loader = this->loader;
+        auto iterator = new EntryIterator(this->source->infos);
+        int total = iterator->isComplete() ? iterator->count() : -1;
+        {
+            QMutexLocker locker(&this->source->mutex);
+            this->source->iterator.reset(iterator);
+        }
+        QMetaObject::invokeMethod(loader, [=]() {
+            loader->receiveIndex(total);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    PageLoader *loader;
+    Source *source;
+};
+
+// Reads a page and decodes it. Pages are read independently, so jobs can run
+// in any order, and in parallel.
+class PageLoader::DecodeJob : public QRunnable
+{
+public:
+    DecodeJob(PageLoader *loader, Source *source, int index,
+              const QSize &viewport) :
+        loader(loader), source(source), index(index), viewport(viewport) {}
+
+    void run() override
+    {
+        // The job is deleted once run() returns, so don't capture it.
+        PageLoader *loader = this->loader;
+        int index = this->index;
+        {
+            QMutexLocker locker(&this->source->mutex);
+            if (!this->source->queued.remove(index))
+                return;
+        }
+
+        // Decode as the page is extracted, so compressed pages don't need to
+        // be held in memory as a whole first. Stored pages are read from a
+        // buffer over the file mapping, which is released with the device.
+        auto iterator = this->source->iterator.data();
+        QElapsedTimer timer;
+        timer.start();
+        QImage image;
+        QSize fullSize;
+        {
+            QScopedPointer<QIODevice> device(iterator->streamAt(index));
+            if (device)
+                image = decode(device.data(), this->viewport, &fullSize);
+            if (!image.isNull() && device->isSequential()
+                    && !readToEnd(device.data()))
+                image = QImage();
+
+            // Some formats need to seek, which a stream can't do. Read those
+            // again, this time in full.
+            if (image.isNull() && device && device->isSequential())
+            {
+                device.reset();
+                auto data = iterator->pageAt(index);
+                QByteArray bytes = data.bytes();
+                QBuffer buffer(&bytes);
+                buffer.open(QIODevice::ReadOnly);
+                image = decode(&buffer, this->viewport, &fullSize);
+            }
+        }
+        qint64 decodeTime = timer.nsecsElapsed();
+        qint64 bytesRead = iterator->sizeAt(index);
+
+        // Make the half-size copies here too, so pages are ready to be scaled
+        // once they arrive.
+        Image page(image);
+        {
+            TRACE_SPAN("mipmaps");
+            page.buildMipmaps();
+        }
+
+        // Report the number of pages once all archives are listed, so the
+        // loader knows where the end is.
+        int total = iterator->isComplete() ? iterator->count() : -1;
+
+        QMetaObject::invokeMethod(loader, [=]() {
+            loader->receive(index, page, fullSize, total, decodeTime,
+                            bytesRead);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    PageLoader *loader;
+    Source *source;
+    int index;
+    QSize viewport;
+};
+
+PageLoader::PageLoader(const QList<QFileInfo> &infos, QObject *parent) :
+    QObject(parent), source(new Source(infos)), indexed(false), total(-1),
+    cachedBytes(0), cacheBudget(0), prefetchDepth(0), prefetchBudget(0),
+    position(-1), direction(1)
+{
+    this->pool.start(new IndexJob(this, this->source), 1);
+}
+
+PageLoader::~PageLoader()
+{
+    this->pool.clear();
+    this->pool.waitForDone();
+    delete this->source;
+}
+
+// Requested pages are kept until the position moves, even past the budget: a
+// turn waiting on the loader needs all the pages it asked for.
+void PageLoader::request(int index)
+{
+    this->wanted.insert(index);
+    if (this->schedule(index, 1))
+        this->requested.insert(index);
+}
+
+// Returns whether the page is being loaded. Requests before sources are
+// walked are dropped; the widget asks again once the index is ready.
+bool PageLoader::schedule(int index, int priority)
+{
+    if (!this->indexed || this->isPastEnd(index) || this->isUpToDate(index))
+        return false;
+
+    QMutexLocker locker(&this->source->mutex);
+    if (this->scheduled.contains(index))
+    {
+        // If the page is queued at a lower priority, queue it again ahead.
+        // Whichever job starts first reads the page, and the other does
+        // nothing.
+        if (priority > 0 && !this->requested.contains(index)
+                && this->source->queued.contains(index))
+            this->pool.start(new DecodeJob(this, this->source, index,
+                                           this->viewport), priority);
+        return true;
+    }
+    this->source->queued.insert(index);
+    this->scheduled.insert(index);
+    this->pool.start(new DecodeJob(this, this->source, index,
+                                   this->viewport), priority);
+    return true;
+}
+
+// Whether the page is decoded, large enough for the viewport. Pages that
+// failed to decode are as good as they get.
+bool PageLoader::isUpToDate(int index) const
+{
+    auto page = this->pages.constFind(index);
+    if (page == this->pages.cend())
+        return false;
+    if (page->image.isNull())
+        return true;
+    auto needed = coveringSize(page->fullSize, this->viewport);
+    auto size = page->image.original().size();
+    return size.width() >= needed.width() && size.height() >= needed.height();
+}
+
+void PageLoader::setPrefetch(int depth, qint64 budget)
+{
+    this->prefetchDepth = depth;
+    this->prefetchBudget = budget;
+    this->prefetch();
+}
+
+void PageLoader::setCacheBudget(qint64 budget)
+{
+    this->cacheBudget = budget;
+    this->evict();
+}
+
+// Pages on screen; second is -1 if there is only one. The position is the
+// later of the two.
+void PageLoader::setPosition(int first, int second)
+{
+    int index = qMax(first, second);
+    if (index > this->position)
+        this->direction = 1;
+    else if (index < this->position)
+        this->direction = -1;
+    this->position = index;
+    this->wanted.clear();
+    this->shown.clear();
+    this->shown.append(first);
+    if (second >= 0)
+        this->shown.append(second);
+    this->renew();
+    this->prefetch();
+    this->evict();
+}
+
+void PageLoader::setViewport(const QSize &size)
+{
+    this->viewport = size;
+    this->renew();
+    this->prefetch();
+}
+
+// Decode the pages on screen again if they are too small for the viewport.
+// They stay loaded, and are shown as they are meanwhile.
+void PageLoader::renew()
+{
+    for (int index : this->shown)
+    {
+        if (this->isLoaded(index))
+            this->request(index);
+    }
+}
+
+// Keep pages in the current direction decoded, up to the configured depth and
+// memory budget.
+void PageLoader::prefetch()
+{
+    if (this->position < 0 || !this->indexed)
+        return;
+
+    // Drop reads queued for the other direction, so they don't hold up pages
+    // the reader actually wants. Explicitly requested pages are kept.
+    {
+        QMutexLocker locker(&this->source->mutex);
+        auto &queued = this->source->queued;
+        for (auto it = queued.begin(); it != queued.end();)
+        {
+            if ((*it - this->position) * this->direction < 0
+                    && !this->requested.contains(*it))
+            {
+                this->scheduled.remove(*it);
+                it = queued.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    // Don't read ahead more than half of the cache, otherwise pages read
+    // ahead would evict each other.
+    qint64 budget = this->prefetchBudget;
+    if (this->cacheBudget > 0
+            && (budget <= 0 || budget > this->cacheBudget / 2))
+        budget = this->cacheBudget / 2;
+
+    qint64 bytes = 0;
+    for (int i = 1; i <= this->prefetchDepth; i++)
+    {
+        int index = this->position + i * this->direction;
+        if (this->isPastEnd(index))
+            break;
+        this->schedule(index, 0);
+        bytes += this->pages.value(index).bytes;
+        if (budget > 0 && bytes >= budget)
+            break;
+    }
+}
+
+// Drop pages farthest from the current position until the cache fits in the
+// budget. Pages on screen, next to the position or asked for are always kept,
+// as is a page just delivered, which would otherwise be read again at once. If
+// only those are left, the cache stays over budget for now.
+void PageLoader::evict(int delivered)
+{
+    // Pages grow as the widget keeps scaled copies of them, which they share
+    // with the copies here; count them as they are now.
+    this->cachedBytes = 0;
+    for (auto &page : this->pages)
+    {
+        page.bytes = page.image.sizeInBytes();
+        this->cachedBytes += page.bytes;
+    }
+
+    while (this->cacheBudget > 0 && this->cachedBytes > this->cacheBudget)
+    {
+        auto victim = this->pages.end();
+        int farthest = 1;
+        for (auto it = this->pages.begin(); it != this->pages.end(); it++)
+        {
+            int distance = qAbs(it.key() - this->position);
+            if (it->bytes > 0 && distance > farthest
+                    && it.key() != delivered
+                    && !this->wanted.contains(it.key())
+                    && !this->shown.contains(it.key()))
+            {
+                victim = it;
+                farthest = distance;
+            }
+        }
+        if (victim == this->pages.end())
+            break;
+        this->cachedBytes -= victim->bytes;
+        this->pages.erase(victim);
+        this->counters.evicted++;
+    }
+}
+
+int PageLoader::count() const
+{
+    return this->total;
+}
+
+bool PageLoader::isLoaded(int index) const
+{
+    return this->pages.contains(index);
+}
+
+bool PageLoader::isPastEnd(int index) const
+{
+    return index < 0 || (this->total >= 0 && index >= this->total);
+}
+
+Image PageLoader::page(int index) const
+{
+    return this->pages.value(index).image;
+}
+
+PageLoader::Stats PageLoader::stats() const
+{
+    Stats stats = this->counters;
+    stats.cachedPages = this->pages.size();
+    stats.cachedBytes = this->cachedBytes;
+    stats.scheduled = this->scheduled.size();
+    return stats;
+}
+
+QString PageLoader::name(int index) const
+{
+    if (!this->indexed)
+        return QString();
+    return this->source->iterator->nameAt(index);
+}
+
+EntryIterator *PageLoader::iterator() const
+{
+    if (!this->indexed)
+        return nullptr;
+    return this->source->iterator.data();
+}
+
+void PageLoader::receiveIndex(int total)
+{
+    this->indexed = true;
+    this->total = total;
+    this->prefetch();
+    emit this->pageLoaded(-1);
+}
+
+void PageLoader::receive(int index, const Image &image, const QSize &fullSize,
+                         int total, qint64 decodeTime, qint64 bytesRead)
+{
+    this->scheduled.remove(index);
+    this->requested.remove(index);
+    if (total >= 0)
+        this->total = total;
+
+    this->counters.decoded++;
+    this->counters.lastDecodeTime = decodeTime;
+    this->counters.decodeTime += decodeTime;
+    this->counters.bytesRead += bytesRead;
+
+    // The page turns out to be past the end; just let the widget know.
+    if (this->isPastEnd(index))
+    {
+        emit this->pageLoaded(index);
+        return;
+    }
+
+    // A page already here is only replaced by a larger one, decoded again
+    // for a larger viewport.
+    auto existing = this->pages.constFind(index);
+    if (existing != this->pages.cend())
+    {
+        if (this->isUpToDate(index) || image.original().width()
+                <= existing->image.original().width())
+            return;
+        this->cachedBytes -= existing->bytes;
+    }
+
+    Page page;
+    page.image = image;
+    page.fullSize = fullSize;
+    page.bytes = image.sizeInBytes();
+    this->pages.insert(index, page);
+    this->cachedBytes += page.bytes;
+    this->evict(index);
+    emit this->pageLoaded(index);
+
+    // The budget may allow more pages now that we know how large this is.
+    if (index != this->position)
+        this->prefetch();
+}
@@ -0,0 +1,126 @@
+#ifndef PAGELOADER_H
+#define PAGELOADER_H
+
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QSize>
+#include <QThreadPool>
+#include "image.h"
+
+class EntryIterator;
+class QFileInfo;
+
+// Reads and decodes pages on worker threads.
+//
+// Pages are numbered as listed by the entry iterator, which is built in the
+// background when the loader is created. The number of pages is only known
+// once every archive is listed, so count() is -1 until then. A page is
+// "loaded" once its decode job has finished, whether or not the data could be
+// decoded; callers should skip loaded pages that are null.
+//
+// Decoded pages, along with their half-size and scaled copies, are kept
+// within a memory budget. Pages farthest from the current position are
+// evicted first, and read again when requested.
+//
+// Given a viewport, pages are decoded only as large as needed to cover it,
+// where the format can do that cheaply (e.g. JPEG). If the viewport grows
+// past that, pages on screen are decoded again, and pageLoaded() is emitted
+// for them once more.
+class PageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PageLoader(const QList<QFileInfo> &infos,
+                        QObject *parent = nullptr);
+    ~PageLoader() override;
+
+    void request(int index);
+    void setPrefetch(int depth, qint64 budget);
+    void setCacheBudget(qint64 budget);
+    void setPosition(int first, int second);
+    void setViewport(const QSize &size);
+
+    int count() const;
+    bool isLoaded(int index) const;
+    bool isPastEnd(int index) const;
+
+    Image page(int index) const;
+    QString name(int index) const;
+
+    // Pages can be read besides the loader with its iterator, e.g. for
+    // thumbnails. This is null until pages are indexed, and goes away with
+    // the loader.
+    EntryIterator *iterator() const;
+
+    // Counters for the performance overlay. Times are in nanoseconds; bytes
+    // read are page data extracted from the sources.
+    struct Stats
+    {
+        Stats() :
+            decoded(0), lastDecodeTime(0), decodeTime(0), bytesRead(0),
+            evicted(0), cachedPages(0), cachedBytes(0), scheduled(0) {}
+
+        int decoded;
+        qint64 lastDecodeTime;
+        qint64 decodeTime;
+        qint64 bytesRead;
+        int evicted;
+        int cachedPages;
+        qint64 cachedBytes;
+        int scheduled;
+    };
+
+    Stats stats() const;
+
+signals:
+    void pageLoaded(int index);
+
+private:
+    class IndexJob;
+    class DecodeJob;
+    struct Source;
+
+    bool schedule(int index, int priority);
+    bool isUpToDate(int index) const;
+    void receiveIndex(int total);
+    void receive(int index, const Image &image, const QSize &fullSize,
+                 int total, qint64 decodeTime, qint64 bytesRead);
+    void prefetch();
+    void renew();
+    void evict(int delivered = -1);
+
+    struct Page
+    {
+        Page() : bytes(0) {}
+
+        Image image;
+        QSize fullSize;
+        qint64 bytes;
+    };
+
+    Source *source;
+    QThreadPool pool;
+    bool indexed;
+    int total;
+
+    QMap<int, Page> pages;
+    QSet<int> scheduled;
+    QSet<int> requested;
+    QSet<int> wanted;
+    qint64 cachedBytes;
+    qint64 cacheBudget;
+
+    int prefetchDepth;
+    qint64 prefetchBudget;
+    int position;
+    int direction;
+    QList<int> shown;
+    QSize viewport;
+
+    Stats counters;
+};
+
+#endif // PAGELOADER_H
@@ -0,0 +1,619 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+#include "resample.h"
+
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) \
+        || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define RESAMPLE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#define RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit the instructions a function is marked for; MSVC
+// emits any intrinsic as it is, so kernels need no marking there.
+#if defined(__GNUC__) || defined(__clang__)
+#define RESAMPLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RESAMPLE_TARGET(isa)
+#endif
+
+namespace
+{
+
+// Weights are fixed point, with this many fractional bits. Sums of pixels
+// times weights still fit in 32 bits, and single weights in 16.
+const int WeightBits = 14;
+const int WeightRound = 1 << (WeightBits - 1);
+
+// Filter weights for one dimension. Every output pixel reads the same number
+// of consecutive input pixels (taps), starting at its own offset. Weights
+// are padded with zeroes where the filter is narrower, and taps are rounded
+// up to a multiple of four where the input is large enough, so the vector
+// kernels can read them in pairs and quads without bounds checks.
+struct Filter
+{
+    int taps;
+    std::vector<int> starts;
+    std::vector<int16_t> weights;
+};
+
+double lanczos3(double x)
+{
+    const double pi = 3.14159265358979323846;
+    x = std::abs(x);
+    if (x < 1e-8)
+        return 1.0;
+    if (x >= 3.0)
+        return 0.0;
+    return 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x);
+}
+
+Filter makeFilter(int inSize, int outSize)
+{
+    double scale = 1.0 * inSize / outSize;
+    double stretch = std::max(scale, 1.0);
+    double support = 3.0 * stretch;
+
+    Filter filter;
+    filter.taps = std::min(static_cast<int>(std::ceil(support)) * 2 + 1,
+                           inSize);
+    int padded = (filter.taps + 3) / 4 * 4;
+    if (padded <= inSize)
+        filter.taps = padded;
+    filter.starts.resize(static_cast<size_t>(outSize));
+    filter.weights.assign(static_cast<size_t>(outSize) * filter.taps, 0);
+
+    std::vector<double> weights;
+    for (int i = 0; i < outSize; i++)
+    {
+        double center = (i + 0.5) * scale;
+        int first = std::max(static_cast<int>(std::floor(center - support)), 0);
+        int end = std::min(static_cast<int>(std::ceil(center + support)),
+                           inSize);
+        end = std::min(end, first + filter.taps);
+
+        weights.clear();
+        double total = 0.0;
+        for (int j = first; j < end; j++)
+        {
+            weights.push_back(lanczos3((j + 0.5 - center) / stretch));
+            total += weights.back();
+        }
+
+        // Shift the window back from the end of the input if needed, so
+        // reads stay in bounds.
+        int start = std::min(first, inSize - filter.taps);
+        filter.starts[static_cast<size_t>(i)] = start;
+        auto out = &filter.weights[static_cast<size_t>(i) * filter.taps
+                                   + (first - start)];
+
+        // Round the weights so they add up exactly, putting the error on the
+        // largest one.
+        int sum = 0;
+        int largest = 0;
+        for (size_t k = 0; k < weights.size(); k++)
+        {
+            out[k] = static_cast<int16_t>(
+                        std::lround(weights[k] / total * (1 << WeightBits)));
+            sum += out[k];
+            if (out[k] > out[largest])
+                largest = static_cast<int>(k);
+        }
+        out[largest] = static_cast<int16_t>(
+                    out[largest] + (1 << WeightBits) - sum);
+    }
+    return filter;
+}
+
+inline uchar clampToByte(int value)
+{
+    return static_cast<uchar>(std::min(std::max(value, 0), 255));
+}
+
+// The filter's negative lobes can leave a color above its alpha, which is not
+// a valid premultiplied pixel (it shows as a halo on transparent edges). The
+// kernels clamp colors to alpha as they store premultiplied pixels. Alpha is
+// the last byte of each pixel, on the little-endian CPUs the kernels target.
+inline void clampToAlpha(uchar *pixel)
+{
+    for (int c = 0; c < 3; c++)
+        pixel[c] = std::min(pixel[c], pixel[3]);
+}
+
+// Filters one row of bpp-byte pixels.
+void horizontalScalar(const uchar *src, uchar *dst, int bpp,
+                      const Filter &filter, int width, bool premultiplied)
+{
+    for (int x = 0; x < width; x++)
+    {
+        auto weights = &filter.weights[static_cast<size_t>(x) * filter.taps];
+        auto s = src + filter.starts[static_cast<size_t>(x)] * bpp;
+        for (int c = 0; c < bpp; c++)
+        {
+            int sum = WeightRound;
+            for (int k = 0; k < filter.taps; k++)
+                sum += weights[k] * s[k * bpp + c];
+            dst[x * bpp + c] = clampToByte(sum >> WeightBits);
+        }
+        if (premultiplied)
+            clampToAlpha(dst + x * bpp);
+    }
+}
+
+// Filters bytes [from, to) of one output row from taps input rows, byte by
+// byte. For premultiplied pixels, the range must start and end on a pixel.
+void verticalScalar(const uchar *const *rows, const int16_t *weights,
+                    int taps, uchar *dst, int from, int to,
+                    bool premultiplied)
+{
+    for (int i = from; i < to; i++)
+    {
+        int sum = WeightRound;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][i];
+        dst[i] = clampToByte(sum >> WeightBits);
+        if (premultiplied && i % 4 == 3)
+            clampToAlpha(dst + i - 3);
+    }
+}
+
+#ifdef RESAMPLE_X86
+
+// Two adjacent weights, as the 16-bit pair _mm_madd_epi16 multiplies with.
+inline int weightPair(const int16_t *weights)
+{
+    int pair;
+    std::memcpy(&pair, weights, sizeof(pair));
+    return pair;
+}
+
+// Each pixel's alpha, in all four of its bytes.
+inline __m128i alphaShuffle()
+{
+    return _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11,
+                         15, 15, 15, 15);
+}
+
+// Horizontal kernels take two (SSE) or four (AVX2) taps at a time. Source
+// pixels are interleaved by channel, so each multiply-add sums a channel of
+// two pixels.
+
+RESAMPLE_TARGET("sse4.1")
+void horizontalSse41(const uchar *src, uchar *dst, const Filter &filter,
+                     int width, bool premultiplied)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1,
+                                          2, -1, 6, -1, 3, -1, 7, -1);
+    const __m128i alpha = alphaShuffle();
+    for (int x = 0; x < width; x++)
+    {
+        auto weights = &filter.weights[static_cast<size_t>(x) * filter.taps];
+        auto s = src + filter.starts[static_cast<size_t>(x)] * 4;
+        __m128i sum = _mm_set1_epi32(WeightRound);
+        for (int k = 0; k < filter.taps; k += 2)
+        {
+            __m128i pixels = _mm_shuffle_epi8(
+                        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(
+                                            s + k * 4)),
+                        shuffle);
+            __m128i pair = _mm_set1_epi32(weightPair(weights + k));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, pair));
+        }
+        sum = _mm_srai_epi32(sum, WeightBits);
+        sum = _mm_packs_epi32(sum, sum);
+        sum = _mm_packus_epi16(sum, sum);
+        if (premultiplied)
+            sum = _mm_min_epu8(sum, _mm_shuffle_epi8(sum, alpha));
+        int pixel = _mm_cvtsi128_si32(sum);
+        std::memcpy(dst + x * 4, &pixel, sizeof(pixel));
+    }
+}
+
+RESAMPLE_TARGET("avx2")
+void horizontalAvx2(const uchar *src, uchar *dst, const Filter &filter,
+                    int width, bool premultiplied)
+{
+    const __m128i alpha = alphaShuffle();
+    // The low lane takes the first two pixels, the high lane the other two.
+    const __m256i shuffle = _mm256_setr_epi8(
+                0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1,
+                8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1, 11, -1, 15, -1);
+    const __m256i spread = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    for (int x = 0; x < width; x++)
+    {
+        auto weights = &filter.weights[static_cast<size_t>(x) * filter.taps];
+        auto s = src + filter.starts[static_cast<size_t>(x)] * 4;
+        __m256i sum = _mm256_setzero_si256();
+        for (int k = 0; k < filter.taps; k += 4)
+        {
+            __m128i quad = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(s + k * 4));
+            __m256i pixels = _mm256_shuffle_epi8(
+                        _mm256_broadcastsi128_si256(quad), shuffle);
+            __m128i quadWeights = _mm_loadl_epi64(
+                        reinterpret_cast<const __m128i *>(weights + k));
+            __m256i pairs = _mm256_permutevar8x32_epi32(
+                        _mm256_castsi128_si256(quadWeights), spread);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pixels, pairs));
+        }
+        __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                      _mm256_extracti128_si256(sum, 1));
+        total = _mm_add_epi32(total, _mm_set1_epi32(WeightRound));
+        total = _mm_srai_epi32(total, WeightBits);
+        total = _mm_packs_epi32(total, total);
+        total = _mm_packus_epi16(total, total);
+        if (premultiplied)
+            total = _mm_min_epu8(total, _mm_shuffle_epi8(total, alpha));
+        int pixel = _mm_cvtsi128_si32(total);
+        std::memcpy(dst + x * 4, &pixel, sizeof(pixel));
+    }
+}
+
+// Vertical kernels take rows in pairs, so taps must be even. Bytes of the two
+// rows are interleaved, so each multiply-add sums a byte of both.
+
+RESAMPLE_TARGET("sse4.1")
+void verticalSse41(const uchar *const *rows, const int16_t *weights,
+                   int taps, uchar *dst, int from, int to, bool premultiplied)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = alphaShuffle();
+    int i = from;
+    for (; i + 16 <= to; i += 16)
+    {
+        __m128i sums[4];
+        for (auto &sum : sums)
+            sum = _mm_set1_epi32(WeightRound);
+        for (int k = 0; k < taps; k += 2)
+        {
+            __m128i a = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(rows[k] + i));
+            __m128i b = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(rows[k + 1] + i));
+            __m128i pair = _mm_set1_epi32(weightPair(weights + k));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(
+                                        _mm_unpacklo_epi8(lo, zero), pair));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(
+                                        _mm_unpackhi_epi8(lo, zero), pair));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(
+                                        _mm_unpacklo_epi8(hi, zero), pair));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(
+                                        _mm_unpackhi_epi8(hi, zero), pair));
+        }
+        for (auto &sum : sums)
+            sum = _mm_srai_epi32(sum, WeightBits);
+        __m128i out = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]),
+                                       _mm_packs_epi32(sums[2], sums[3]));
+        if (premultiplied)
+            out = _mm_min_epu8(out, _mm_shuffle_epi8(out, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+    }
+    verticalScalar(rows, weights, taps, dst, i, to, premultiplied);
+}
+
+RESAMPLE_TARGET("avx2")
+void verticalAvx2(const uchar *const *rows, const int16_t *weights,
+                  int taps, uchar *dst, int from, int to, bool premultiplied)
+{
+    // Unpacking and packing both work within lanes, so bytes end up where
+    // they started.
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_broadcastsi128_si256(alphaShuffle());
+    int i = from;
+    for (; i + 32 <= to; i += 32)
+    {
+        __m256i sums[4];
+        for (auto &sum : sums)
+            sum = _mm256_set1_epi32(WeightRound);
+        for (int k = 0; k < taps; k += 2)
+        {
+            __m256i a = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(rows[k] + i));
+            __m256i b = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(rows[k + 1] + i));
+            __m256i pair = _mm256_set1_epi32(weightPair(weights + k));
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(
+                                           _mm256_unpacklo_epi8(lo, zero), pair));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(
+                                           _mm256_unpackhi_epi8(lo, zero), pair));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(
+                                           _mm256_unpacklo_epi8(hi, zero), pair));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(
+                                           _mm256_unpackhi_epi8(hi, zero), pair));
+        }
+        for (auto &sum : sums)
+            sum = _mm256_srai_epi32(sum, WeightBits);
+        __m256i out = _mm256_packus_epi16(
+                    _mm256_packs_epi32(sums[0], sums[1]),
+                    _mm256_packs_epi32(sums[2], sums[3]));
+        if (premultiplied)
+            out = _mm256_min_epu8(out, _mm256_shuffle_epi8(out, alpha));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), out);
+    }
+    verticalSse41(rows, weights, taps, dst, i, to, premultiplied);
+}
+
+#endif  // RESAMPLE_X86
+
+#ifdef RESAMPLE_NEON
+
+// Each pixel's alpha, in all four of its bytes.
+const uint8_t alphaIndices[8] = {3, 3, 3, 3, 7, 7, 7, 7};
+
+void horizontalNeon(const uchar *src, uchar *dst, const Filter &filter,
+                    int width, bool premultiplied)
+{
+    const uint8x8_t alpha = vld1_u8(alphaIndices);
+    for (int x = 0; x < width; x++)
+    {
+        auto weights = &filter.weights[static_cast<size_t>(x) * filter.taps];
+        auto s = src + filter.starts[static_cast<size_t>(x)] * 4;
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int k = 0; k < filter.taps; k++)
+        {
+            uint32_t pixel;
+            std::memcpy(&pixel, s + k * 4, sizeof(pixel));
+            int16x4_t channels = vget_low_s16(vreinterpretq_s16_u16(
+                    vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(pixel)))));
+            sum = vmlal_n_s16(sum, channels, weights[k]);
+        }
+        int16x4_t narrowed = vqrshrn_n_s32(sum, WeightBits);
+        uint8x8_t out = vqmovun_s16(vcombine_s16(narrowed, narrowed));
+        if (premultiplied)
+            out = vmin_u8(out, vtbl1_u8(out, alpha));
+        uint32_t pixel = vget_lane_u32(vreinterpret_u32_u8(out), 0);
+        std::memcpy(dst + x * 4, &pixel, sizeof(pixel));
+    }
+}
+
+void verticalNeon(const uchar *const *rows, const int16_t *weights,
+                  int taps, uchar *dst, int from, int to, bool premultiplied)
+{
+    const uint8x8_t alpha = vld1_u8(alphaIndices);
+    int i = from;
+    for (; i + 8 <= to; i += 8)
+    {
+        int32x4_t lo = vdupq_n_s32(0);
+        int32x4_t hi = vdupq_n_s32(0);
+        for (int k = 0; k < taps; k++)
+        {
+            int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[k] + i)));
+            lo = vmlal_n_s16(lo, vget_low_s16(v), weights[k]);
+            hi = vmlal_n_s16(hi, vget_high_s16(v), weights[k]);
+        }
+        int16x8_t narrowed = vcombine_s16(vqrshrn_n_s32(lo, WeightBits),
+                                          vqrshrn_n_s32(hi, WeightBits));
+        uint8x8_t out = vqmovun_s16(narrowed);
+        if (premultiplied)
+            out = vmin_u8(out, vtbl1_u8(out, alpha));
+        vst1_u8(dst + i, out);
+    }
+    verticalScalar(rows, weights, taps, dst, i, to, premultiplied);
+}
+
+#endif  // RESAMPLE_NEON
+
+#ifdef RESAMPLE_X86
+
+// Whether the CPU has the instruction sets, and for AVX2 whether the OS saves
+// the wider registers. MSVC has no __builtin_cpu_supports, so ask CPUID.
+void detectX86(bool *sse41, bool *avx2)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int leaves = info[0];
+    __cpuid(info, 1);
+    // SSE4.1 is ECX bit 19, OSXSAVE bit 27 and AVX bit 28.
+    *sse41 = (info[2] & (1 << 19)) != 0;
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28))
+            && (_xgetbv(0) & 6) == 6;
+    *avx2 = false;
+    if (avx && leaves >= 7)
+    {
+        // AVX2 is EBX bit 5 of leaf 7.
+        __cpuidex(info, 7, 0);
+        *avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    *sse41 = __builtin_cpu_supports("sse4.1");
+    *avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  // RESAMPLE_X86
+
+// The best kernels this CPU can run, picked once. Horizontal kernels only
+// handle 4-byte pixels, with taps a multiple of four.
+struct Kernels
+{
+    Kernels() : horizontal(nullptr), vertical(verticalScalar)
+    {
+#if defined(RESAMPLE_X86)
+        bool sse41, avx2;
+        detectX86(&sse41, &avx2);
+        if (avx2)
+        {
+            this->horizontal = horizontalAvx2;
+            this->vertical = verticalAvx2;
+        }
+        else if (sse41)
+        {
+            this->horizontal = horizontalSse41;
+            this->vertical = verticalSse41;
+        }
+#elif defined(RESAMPLE_NEON)
+        this->horizontal = horizontalNeon;
+        this->vertical = verticalNeon;
+#endif
+    }
+
+    void (*horizontal)(const uchar *src, uchar *dst, const Filter &filter,
+                       int width, bool premultiplied);
+    void (*vertical)(const uchar *const *rows, const int16_t *weights,
+                     int taps, uchar *dst, int from, int to,
+                     bool premultiplied);
+};
+
+// Bands are claimed one at a time, by the calling thread and helpers on the
+// global pool. Helpers that only start after every band is taken just return,
+// so the caller never waits on a busy pool, only on bands being filtered.
+struct Bands
+{
+    QAtomicInt next;
+    int count;
+    QSemaphore done;
+    std::function<void(int)> run;
+};
+
+void runBands(Bands &bands)
+{
+    int band;
+    while ((band = bands.next.fetchAndAddRelaxed(1)) < bands.count)
+    {
+        bands.run(band);
+        bands.done.release();
+    }
+}
+
+class BandJob : public QRunnable
+{
+public:
+    BandJob(const QSharedPointer<Bands> &bands) : bands(bands) {}
+
+    void run() override
+    {
+        runBands(*this->bands);
+    }
+
+private:
+    QSharedPointer<Bands> bands;
+};
+
+// Minimum rows per band, so small images are filtered on the calling thread.
+const int BandRows = 64;
+
+void forEachBand(int rows, const std::function<void(int, int)> &run)
+{
+    int threads = std::max(QThread::idealThreadCount(), 1);
+    int count = std::max(std::min(rows / BandRows, threads * 4), 1);
+    auto bandRows = (rows + count - 1) / count;
+    auto band = [=](int index) {
+        run(index * bandRows, std::min((index + 1) * bandRows, rows));
+    };
+    if (count == 1)
+    {
+        band(0);
+        return;
+    }
+
+    QSharedPointer<Bands> bands(new Bands);
+    bands->count = count;
+    bands->run = band;
+    for (int i = 1; i < std::min(threads, count); i++)
+        QThreadPool::globalInstance()->start(new BandJob(bands));
+    runBands(*bands);
+    bands->done.acquire(count);
+}
+
+// Grayscale images stay 8-bit; anything else is filtered as 32-bit pixels,
+// with alpha premultiplied so transparent pixels don't bleed their color.
+QImage normalized(const QImage &image)
+{
+    switch (image.format())
+    {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return image;
+    default:
+        break;
+    }
+    if (image.hasAlphaChannel())
+        return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    if (image.isGrayscale())
+        return image.convertToFormat(QImage::Format_Grayscale8);
+    return image.convertToFormat(QImage::Format_RGB32);
+}
+
+}   // (anonymous namespace)
+
+QImage resampled(const QImage &image, int w, int h)
+{
+    if (image.isNull() || w <= 0 || h <= 0)
+        return QImage();
+
+    static const Kernels kernels;
+    QImage source = normalized(image);
+    int bpp = source.depth() / 8;
+    bool premultiplied =
+            source.format() == QImage::Format_ARGB32_Premultiplied;
+    Filter horizontal = makeFilter(source.width(), w);
+    Filter vertical = makeFilter(source.height(), h);
+
+    // Filter rows first, into an image as wide as the result, then columns
+    // from that. Only rows the column filter reads are filtered.
+    int first = vertical.starts.front();
+    int end = vertical.starts.back() + vertical.taps;
+    QImage rows(w, end - first, source.format());
+    QImage result(w, h, source.format());
+    if (rows.isNull() || result.isNull())
+        return QImage();
+
+    auto horizontalKernel = kernels.horizontal;
+    if (bpp != 4 || horizontal.taps % 4)
+        horizontalKernel = nullptr;
+    forEachBand(end - first, [&](int from, int to) {
+        for (int y = from; y < to; y++)
+        {
+            auto src = source.constScanLine(first + y);
+            auto dst = rows.scanLine(y);
+            if (horizontalKernel)
+                horizontalKernel(src, dst, horizontal, w, premultiplied);
+            else
+                horizontalScalar(src, dst, bpp, horizontal, w,
+                                 premultiplied);
+        }
+    });
+
+    // Vector kernels take rows in pairs; pad odd taps with a zero weight.
+    int taps = (vertical.taps + 1) / 2 * 2;
+    forEachBand(h, [&](int from, int to) {
+        std::vector<const uchar *> sources(static_cast<size_t>(taps));
+        std::vector<int16_t> weights(static_cast<size_t>(taps), 0);
+        for (int y = from; y < to; y++)
+        {
+            auto start = vertical.starts[static_cast<size_t>(y)] - first;
+            for (int k = 0; k < taps; k++)
+            {
+                auto row = std::min(start + k, rows.height() - 1);
+                sources[static_cast<size_t>(k)] = rows.constScanLine(row);
+            }
+            std::copy_n(&vertical.weights[static_cast<size_t>(y)
+                                          * vertical.taps],
+                        vertical.taps, weights.begin());
+            kernels.vertical(sources.data(), weights.data(), taps,
+                             result.scanLine(y), 0, w * bpp, premultiplied);
+        }
+    });
+    return result;
+}
@@ -0,0 +1,16 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <QImage>
+
+// Scales an image to exactly w x h with a separable Lanczos-3 filter. When
+// shrinking, the filter is widened by the reduction ratio, so every source
+// pixel contributes (i.e. it averages areas, where bilinear skips pixels).
+//
+// Grayscale images stay 8-bit; others are filtered as RGB32 or premultiplied
+// ARGB32, and the result is in that format. Large images are split into row
+// bands, which are filtered on the global thread pool. This is safe to call
+// from any thread.
+QImage resampled(const QImage &image, int w, int h);
+
+#endif // RESAMPLE_H
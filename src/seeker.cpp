@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <QIcon>
+#include <QScrollBar>
+#include "seeker.h"
+#include "thumbnailcache.h"
+
+Seeker::Seeker(QWidget *parent) : QListWidget(parent), first(0)
+{
+    // Keep the keyboard for turning pages.
+    this->setFocusPolicy(Qt::NoFocus);
+
+    this->setViewMode(QListView::IconMode);
+    this->setFlow(QListView::LeftToRight);
+    this->setWrapping(false);
+    this->setMovement(QListView::Static);
+    this->setLayoutDirection(Qt::RightToLeft);
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    this->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setUniformItemSizes(true);
+
+    // Spreads are shown as wide as a page, so they don't stretch the strip.
+    int h = ThumbnailCache::Height;
+    this->setIconSize(QSize(h, h));
+    this->setGridSize(QSize(h + 8, h + this->fontMetrics().height() + 12));
+
+    this->setStyleSheet("QListWidget { background: rgba(0, 0, 0, 200);"
+                        "color: white; border: none; }");
+
+    this->connect(this, &QListWidget::itemClicked,
+                  this, [this](QListWidgetItem *item) {
+        emit this->pageSelected(this->first + this->row(item));
+    });
+}
+
+// Thumbnails already shown are kept if the span stays the same.
+void Seeker::setSpan(int first, int count)
+{
+    if (first == this->first && count == this->count())
+        return;
+    this->clear();
+    this->first = first;
+    for (int i = 0; i < count; i++)
+    {
+        auto item = new QListWidgetItem(QString::number(first + i + 1), this);
+        item->setTextAlignment(Qt::AlignCenter);
+    }
+}
+
+// Thumbnails of pages outside the span are dropped. A null thumbnail marks a
+// page that has none, so it is not asked for again.
+void Seeker::setThumbnail(int index, const QImage &thumbnail)
+{
+    auto item = this->item(index - this->first);
+    if (!item)
+        return;
+    if (thumbnail.isNull())
+        item->setData(Qt::UserRole, true);
+    else
+        item->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+}
+
+void Seeker::setCurrent(int index)
+{
+    auto item = this->item(index - this->first);
+    if (!item)
+        return;
+    this->setCurrentItem(item);
+    this->scrollToItem(item, QAbstractItemView::PositionAtCenter);
+}
+
+// Pages ahead come before pages as far behind, since reading goes forward.
+QList<int> Seeker::missing(int around) const
+{
+    QList<int> indexes;
+    for (int row = 0; row < this->count(); row++)
+    {
+        auto item = this->item(row);
+        if (item->icon().isNull() && !item->data(Qt::UserRole).toBool())
+            indexes.append(this->first + row);
+    }
+    auto rank = [=](int index) {
+        return qAbs(index - around) * 2 - (index > around ? 1 : 0);
+    };
+    std::sort(indexes.begin(), indexes.end(), [=](int a, int b) {
+        return rank(a) < rank(b);
+    });
+    return indexes;
+}
+
+int Seeker::preferredHeight() const
+{
+    return this->gridSize().height() + this->horizontalScrollBar()->sizeHint()
+            .height() + 2 * this->frameWidth();
+}
@@ -0,0 +1,34 @@
+#ifndef SEEKER_H
+#define SEEKER_H
+
+#include <QListWidget>
+
+// A strip of page thumbnails to jump around with. Pages run right to left,
+// in reading order. Pages are listed by number until their thumbnails come.
+//
+// Only a span of pages is shown at a time, e.g. those of the archive being
+// read. Pages are numbered as the page loader numbers them.
+class Seeker : public QListWidget
+{
+    Q_OBJECT
+
+public:
+    explicit Seeker(QWidget *parent = nullptr);
+
+    void setSpan(int first, int count);
+    void setThumbnail(int index, const QImage &thumbnail);
+    void setCurrent(int index);
+
+    // Pages in the span still to be thumbnailed, nearest to around first.
+    QList<int> missing(int around) const;
+
+    int preferredHeight() const;
+
+signals:
+    void pageSelected(int index);
+
+private:
+    int first;
+};
+
+#endif // SEEKER_H
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+#include "thumbnailcache.h"
+
+// Returns an empty string if there is no cache directory.
+static QString directory()
+{
+    auto dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty())
+        return QString();
+    return QDir(dir).filePath("thumbnails");
+}
+
+// Files are spread over subdirectories by the first two digits of the hash,
+// so no directory gets too large. Returns an empty string if there is no
+// cache directory.
+static QString fileName(const QFileInfo &source, int entry)
+{
+    auto dir = directory();
+    if (dir.isEmpty())
+        return QString();
+    auto key = QString("%1\t%2\t%3\t%4\t%5").arg(source.size())
+            .arg(source.lastModified().toMSecsSinceEpoch())
+            .arg(entry).arg(ThumbnailCache::Height)
+            .arg(source.absoluteFilePath());
+    auto hash = QString::fromLatin1(QCryptographicHash::hash(
+            key.toUtf8(), QCryptographicHash::Sha1).toHex());
+    return QDir(dir).filePath(
+                QString("%1/%2.jpg").arg(hash.left(2)).arg(hash.mid(2)));
+}
+
+QImage ThumbnailCache::find(const QFileInfo &source, int entry)
+{
+    auto name = fileName(source, entry);
+    if (name.isEmpty())
+        return QImage();
+    return QImageReader(name, "jpeg").read();
+}
+
+// Thumbnails are written to a temporary file and renamed into place, so a
+// reader never sees half of one, even from another instance.
+void ThumbnailCache::insert(const QFileInfo &source, int entry,
+                            const QImage &thumbnail)
+{
+    auto name = fileName(source, entry);
+    if (name.isEmpty() || !QDir().mkpath(QFileInfo(name).absolutePath()))
+        return;
+    QSaveFile file(name);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QImageWriter writer(&file, "jpeg");
+    writer.setQuality(85);
+    if (writer.write(thumbnail))
+        file.commit();
+}
+
+// Deletes the oldest thumbnails until the cache fits in the budget. This walks
+// the whole cache, so it is meant to be done once in a while, off the GUI
+// thread.
+void ThumbnailCache::prune()
+{
+    auto dir = directory();
+    if (dir.isEmpty())
+        return;
+
+    struct File
+    {
+        QString path;
+        qint64 size;
+        qint64 modified;
+    };
+    QVector<File> files;
+    qint64 total = 0;
+    QDirIterator diriter(dir, QStringList() << "*.jpg", QDir::Files,
+                         QDirIterator::Subdirectories);
+    while (!diriter.next().isEmpty())
+    {
+        auto info = diriter.fileInfo();
+        files.append({info.absoluteFilePath(), info.size(),
+                      info.lastModified().toMSecsSinceEpoch()});
+        total += info.size();
+    }
+    if (total <= Budget)
+        return;
+
+    std::sort(files.begin(), files.end(), [](const File &a, const File &b) {
+        return a.modified < b.modified;
+    });
+    for (const auto &file : files)
+    {
+        if (total <= Budget)
+            break;
+        if (QFile::remove(file.path))
+            total -= file.size;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QImage>
+
+class QFileInfo;
+
+// Small copies of pages, kept in the cache directory across runs. A thumbnail
+// is stored under a hash of its source's path, size and modification time and
+// the page's entry in it, so a changed file gets new thumbnails. Old ones are
+// never looked up again, and go once prune() needs the room. This is safe to
+// use from any thread.
+class ThumbnailCache
+{
+public:
+    // Thumbnails fit in a box of this height, twice as wide (for spreads).
+    static const int Height = 160;
+
+    // Size the cache is pruned down to, in bytes.
+    static const qint64 Budget = Q_INT64_C(256) << 20;
+
+    static QImage find(const QFileInfo &source, int entry);
+    static void insert(const QFileInfo &source, int entry,
+                       const QImage &thumbnail);
+    static void prune();
+};
+
+#endif // THUMBNAILCACHE_H
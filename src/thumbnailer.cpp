@@ -0,0 +1,158 @@
+#include <QBuffer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QThread>
+#include "entryiterator.h"
+#include "thumbnailcache.h"
+#include "thumbnailer.h"
+#include "trace.h"
+
+// Decodes straight to thumbnail size. Qt scales after decoding for formats
+// that can't decode at a smaller size themselves.
+static QImage decodeThumbnail(QIODevice *device)
+{
+    TRACE_SPAN("thumbnail");
+    QImageReader reader(device);
+    QSize box(ThumbnailCache::Height * 2, ThumbnailCache::Height);
+    QSize size = reader.size();
+    if (size.isValid())
+    {
+        reader.setScaledSize(size.scaled(box, Qt::KeepAspectRatio)
+                             .expandedTo(QSize(1, 1)));
+        return reader.read();
+    }
+    QImage image = reader.read();
+    if (image.isNull())
+        return image;
+    return image.scaled(box, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+// Works through one request, until a newer one comes.
+class Thumbnailer::Job : public QRunnable
+{
+public:
+    Job(Thumbnailer *thumbnailer, int serial, const QList<int> &indexes) :
+        thumbnailer(thumbnailer), serial(serial), indexes(indexes) {}
+
+    void run() override
+    {
+        // Pages the reader waits for come first.
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+        auto iterator = this->thumbnailer->iterator;
+        QList<int> missing;
+        for (int index : this->indexes)
+        {
+            if (this->isStale())
+                return;
+            QImage thumbnail = ThumbnailCache::find(
+                        QFileInfo(iterator->nameAt(index)),
+                        iterator->entryAt(index));
+            if (thumbnail.isNull())
+                missing.append(index);
+            else
+                this->report(index, thumbnail);
+        }
+
+        for (int index : missing)
+        {
+            if (this->isStale())
+                return;
+            QImage thumbnail;
+            {
+                QScopedPointer<QIODevice> device(iterator->streamAt(index));
+                if (device)
+                    thumbnail = decodeThumbnail(device.data());
+
+                // Some formats need to seek, which a stream can't do, and
+                // some entries can't be streamed at all. Read those whole.
+                if (thumbnail.isNull())
+                {
+                    device.reset();
+                    QByteArray bytes = iterator->pageAt(index).bytes();
+                    QBuffer buffer(&bytes);
+                    buffer.open(QIODevice::ReadOnly);
+                    thumbnail = decodeThumbnail(&buffer);
+                }
+            }
+            if (thumbnail.isNull())
+            {
+                this->report(index, thumbnail);
+                continue;
+            }
+            ThumbnailCache::insert(QFileInfo(iterator->nameAt(index)),
+                                   iterator->entryAt(index), thumbnail);
+            this->report(index, thumbnail);
+        }
+    }
+
+private:
+    bool isStale() const
+    {
+        return this->thumbnailer->serial.loadAcquire() != this->serial;
+    }
+
+    void report(int index, const QImage &thumbnail)
+    {
+        Thumbnailer *thumbnailer = this->thumbnailer;
+        QMetaObject::invokeMethod(thumbnailer, [=]() {
+            thumbnailer->receive(index, thumbnail);
+        }, Qt::QueuedConnection);
+    }
+
+    Thumbnailer *thumbnailer;
+    int serial;
+    QList<int> indexes;
+};
+
+// The cache is pruned once per run: 0 until a prune is queued, 1 while it is,
+// and 2 once it is done.
+static QAtomicInt pruneState;
+
+class Thumbnailer::PruneJob : public QRunnable
+{
+public:
+    void run() override
+    {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        ThumbnailCache::prune();
+        pruneState.storeRelease(2);
+    }
+};
+
+Thumbnailer::Thumbnailer(EntryIterator *iterator, QObject *parent) :
+    QObject(parent), iterator(iterator), serial(0)
+{
+    this->pool.setMaxThreadCount(1);
+}
+
+// A prune still queued is dropped, and left to the next thumbnailer.
+Thumbnailer::~Thumbnailer()
+{
+    this->cancel();
+    this->pool.clear();
+    this->pool.waitForDone();
+    pruneState.testAndSetOrdered(1, 0);
+}
+
+// The prune is queued behind the first request, so it doesn't hold up the
+// thumbnails the reader wants to see.
+void Thumbnailer::request(const QList<int> &indexes)
+{
+    this->pool.start(new Job(this, this->serial.fetchAndAddOrdered(1) + 1,
+                             indexes), 1);
+    if (pruneState.testAndSetOrdered(0, 1))
+        this->pool.start(new PruneJob());
+}
+
+void Thumbnailer::cancel()
+{
+    this->serial.fetchAndAddOrdered(1);
+}
+
+void Thumbnailer::receive(int index, const QImage &thumbnail)
+{
+    emit this->thumbnailReady(index, thumbnail);
+}
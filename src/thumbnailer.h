@@ -0,0 +1,47 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QThreadPool>
+
+class EntryIterator;
+
+// Makes thumbnails of pages in the background, in the order they are asked
+// for, reading them with the page loader's iterator. Thumbnails already in
+// the cache are reported first, so pages seen before are covered at once; the
+// rest are decoded at thumbnail size where the format allows, and cached.
+// Pages that can't be decoded are reported with a null image.
+//
+// A request replaces whatever was asked for before. The iterator must outlive
+// the thumbnailer.
+class Thumbnailer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Thumbnailer(EntryIterator *iterator, QObject *parent = nullptr);
+    ~Thumbnailer() override;
+
+    void request(const QList<int> &indexes);
+    void cancel();
+
+signals:
+    void thumbnailReady(int index, const QImage &thumbnail);
+
+private:
+    class Job;
+    class PruneJob;
+
+    void receive(int index, const QImage &thumbnail);
+
+    EntryIterator *iterator;
+    QThreadPool pool;
+
+    // Bumped by each request or cancel; jobs for an older one stop.
+    QAtomicInt serial;
+};
+
+#endif // THUMBNAILER_H
@@ -0,0 +1,137 @@
+#include <QAtomicPointer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include "trace.h"
+
+namespace
+{
+
+struct Event
+{
+    const char *name;
+    qint64 start;
+    qint64 end;
+};
+
+// Events of one thread. Only that thread appends to it, and it publishes the
+// count after each event, so the trace can be written while threads are
+// still recording. Buffers are never freed; pool threads come and go, but
+// not many of them.
+struct Buffer
+{
+    static const int Capacity = 1 << 16;
+
+    Buffer(int thread, bool main) :
+        next(nullptr), thread(thread), main(main), count(0), dropped(0)
+    {
+    }
+
+    Buffer *next;
+    int thread;
+    bool main;
+    QAtomicInt count;
+    QAtomicInt dropped;
+    Event events[Capacity];
+};
+
+QElapsedTimer timer;
+QAtomicPointer<Buffer> buffers;
+QAtomicInt threads;
+thread_local Buffer *local = nullptr;
+
+Buffer *localBuffer()
+{
+    if (local)
+        return local;
+    auto app = QCoreApplication::instance();
+    bool main = app && QThread::currentThread() == app->thread();
+    local = new Buffer(threads.fetchAndAddRelaxed(1) + 1, main);
+
+    // Push onto the list of buffers.
+    Buffer *head;
+    do
+    {
+        head = buffers.loadAcquire();
+        local->next = head;
+    }
+    while (!buffers.testAndSetRelease(head, local));
+    return local;
+}
+
+QByteArray microseconds(qint64 nanoseconds)
+{
+    return QByteArray::number(nanoseconds / 1e3, 'f', 3);
+}
+
+}   // (anonymous namespace)
+
+QAtomicInt Trace::enabled(0);
+
+void Trace::start()
+{
+    if (enabled.loadAcquire())
+        return;
+    timer.start();
+    enabled.storeRelease(1);
+}
+
+qint64 Trace::now()
+{
+    return timer.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 start, qint64 end)
+{
+    auto buffer = localBuffer();
+    int count = buffer->count.loadAcquire();
+    if (count >= Buffer::Capacity)
+    {
+        buffer->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    buffer->events[count] = {name, start, end};
+    buffer->count.storeRelease(count + 1);
+}
+
+// Writes complete ("X") events, one track per thread, plus thread names.
+bool Trace::write(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray out = "{\"traceEvents\":[\n";
+    int dropped = 0;
+    for (auto buffer = buffers.loadAcquire(); buffer; buffer = buffer->next)
+    {
+        QByteArray tid = QByteArray::number(buffer->thread);
+        QByteArray name = buffer->main ? QByteArray("main")
+                                       : "worker " + tid;
+        out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                + tid + ",\"args\":{\"name\":\"" + name + "\"}},\n";
+
+        int count = buffer->count.loadAcquire();
+        for (int i = 0; i < count; i++)
+        {
+            const auto &event = buffer->events[i];
+            out += "{\"name\":\"" + QByteArray(event.name)
+                    + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid
+                    + ",\"ts\":" + microseconds(event.start)
+                    + ",\"dur\":" + microseconds(event.end - event.start)
+                    + "},\n";
+        }
+        dropped += buffer->dropped.loadAcquire();
+
+        if (out.size() > (1 << 20))
+        {
+            file.write(out);
+            out.clear();
+        }
+    }
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+           "\"args\":{\"name\":\"komiq\"}}\n],\"otherData\":{\"dropped\":"
+            + QByteArray::number(dropped) + "}}\n";
+    return file.write(out) == out.size() && file.flush();
+}
@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+class QString;
+
+// Spans of time on the page pipeline's hot paths, written out as a Chrome
+// trace (open it in chrome://tracing or ui.perfetto.dev).
+//
+// Spans are recorded only once start() is called. Until then a span costs a
+// load and a branch; build with "qmake CONFIG+=no_trace" to compile them out
+// altogether. Each thread records into a buffer of its own, so recording
+// takes no locks; spans past a buffer's capacity are dropped.
+class Trace
+{
+public:
+    static void start();
+    static bool write(const QString &path);
+
+    static bool isEnabled() { return enabled.loadAcquire(); }
+    static qint64 now();
+
+    // The name must outlive the trace, i.e. be a string literal.
+    static void record(const char *name, qint64 start, qint64 end);
+
+private:
+    static QAtomicInt enabled;
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name) :
+        name(name), start(Trace::isEnabled() ? Trace::now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (this->start >= 0)
+            Trace::record(this->name, this->start, Trace::now());
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    qint64 start;
+};
+
+// Records a span from here to the end of the enclosing scope.
+#ifdef KOMIQ_NO_TRACE
+#define TRACE_SPAN(name) do {} while (false)
+#else
+#define TRACE_SPAN_VARIABLE(line) traceSpan##line
+#define TRACE_SPAN_AT(name, line) TraceSpan TRACE_SPAN_VARIABLE(line)(name)
+#define TRACE_SPAN(name) TRACE_SPAN_AT(name, __LINE__)
+#endif
+
+#endif // TRACE_H
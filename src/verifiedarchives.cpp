@@ -0,0 +1,152 @@
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextStream>
+#include "verifiedarchives.h"
+
+namespace
+{
+
+// One archive per line: size, modification time (ms since epoch), and path,
+// separated by tabs. New archives are appended; the list is rewritten without
+// archives that changed or are gone when it is loaded.
+struct Store
+{
+    Store() : loaded(false) {}
+
+    static QString key(const QFileInfo &info)
+    {
+        return QString("%1\t%2\t%3").arg(info.size())
+                .arg(info.lastModified().toMSecsSinceEpoch())
+                .arg(info.absoluteFilePath());
+    }
+
+    QString fileName() const
+    {
+        auto dir = QStandardPaths::writableLocation(
+                    QStandardPaths::CacheLocation);
+        if (dir.isEmpty())
+            return QString();
+        return QDir(dir).filePath("verified-archives");
+    }
+
+    void load()
+    {
+        if (this->loaded)
+            return;
+        this->loaded = true;
+
+        QFile file(this->fileName());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return;
+        QTextStream in(&file);
+        in.setCodec("UTF-8");
+        QString line;
+        int lines = 0;
+        while (in.readLineInto(&line))
+        {
+            if (line.isEmpty())
+                continue;
+            lines++;
+            auto path = line.section('\t', 2);
+            if (!path.isEmpty() && key(QFileInfo(path)) == line)
+                this->keys.insert(line);
+        }
+        file.close();
+        if (this->keys.size() < lines)
+            this->rewrite();
+    }
+
+    // Written to a temporary file and renamed into place, so another
+    // instance reading the list never sees half of it.
+    void rewrite()
+    {
+        QSaveFile file(this->fileName());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            return;
+        QTextStream out(&file);
+        out.setCodec("UTF-8");
+        for (const auto &line : this->keys)
+            out << line << endl;
+        out.flush();
+        file.commit();
+    }
+
+    void append(const QString &key)
+    {
+        auto name = this->fileName();
+        if (name.isEmpty() || !QDir().mkpath(QFileInfo(name).absolutePath()))
+            return;
+        QFile file(name);
+        if (!file.open(QIODevice::Append | QIODevice::Text))
+            return;
+        QTextStream out(&file);
+        out.setCodec("UTF-8");
+        out << key << endl;
+    }
+
+    QMutex mutex;
+    bool loaded;
+    QSet<QString> keys;
+
+    // Flags of archives being verified. An entry lapses once no reader of
+    // the archive is left, so a failed archive is tried again next time it
+    // is opened.
+    QHash<QString, QWeakPointer<QAtomicInt>> claims;
+};
+
+Store store;
+
+}   // (anonymous namespace)
+
+bool VerifiedArchives::contains(const QFileInfo &info)
+{
+    QMutexLocker locker(&store.mutex);
+    store.load();
+    return store.keys.contains(Store::key(info));
+}
+
+void VerifiedArchives::insert(const QFileInfo &info)
+{
+    QMutexLocker locker(&store.mutex);
+    store.load();
+    auto key = Store::key(info);
+    if (store.keys.contains(key))
+        return;
+    store.keys.insert(key);
+    store.append(key);
+}
+
+QSharedPointer<QAtomicInt> VerifiedArchives::claim(const QFileInfo &info,
+                                                   bool *first)
+{
+    QMutexLocker locker(&store.mutex);
+    store.load();
+    auto key = Store::key(info);
+    *first = false;
+    if (store.keys.contains(key))
+        return QSharedPointer<QAtomicInt>(new QAtomicInt(1));
+
+    QSharedPointer<QAtomicInt> flag = store.claims.value(key).toStrongRef();
+    if (!flag)
+    {
+        // Drop entries of archives no one reads any more, while at it.
+        for (auto it = store.claims.begin(); it != store.claims.end();)
+        {
+            if (it.value().isNull())
+                it = store.claims.erase(it);
+            else
+                it++;
+        }
+        flag.reset(new QAtomicInt(0));
+        store.claims.insert(key, flag);
+        *first = true;
+    }
+    return flag;
+}
@@ -0,0 +1,26 @@
+#ifndef VERIFIEDARCHIVES_H
+#define VERIFIEDARCHIVES_H
+
+#include <QAtomicInt>
+#include <QSharedPointer>
+
+class QFileInfo;
+
+// Archives whose entries have all been checked against their CRC-32, so later
+// reads can skip the check. Archives are identified by path, size and
+// modification time, so a changed file is verified again. The list is kept in
+// the cache directory across runs, and is safe to use from any thread.
+class VerifiedArchives
+{
+public:
+    static bool contains(const QFileInfo &info);
+    static void insert(const QFileInfo &info);
+
+    // Verification in this process, shared by every reader of the archive.
+    // Returns a flag that is set once the archive is verified. The first
+    // caller for an archive not yet verified gets first set to true, and
+    // should verify it; others wait for that.
+    static QSharedPointer<QAtomicInt> claim(const QFileInfo &info, bool *first);
+};
+
+#endif // VERIFIEDARCHIVES_H
@@ -0,0 +1,491 @@
+/*
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fastinflate.h"
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64) ||               \
+    defined(__i386__) || defined(__x86_64__)
+#define FAST_INFLATE_LITTLE_ENDIAN 1
+#endif
+
+// Bits indexing the first level of each decode table. Longer codes continue
+// in a subtable.
+#define LITLEN_TABLE_BITS 11
+#define DIST_TABLE_BITS 8
+#define PRECODE_TABLE_BITS 7
+
+// Largest possible tables: the first level, plus a subtable as large as the
+// longest code (15 bits) allows for every symbol.
+#define LITLEN_TABLE_SIZE                                                      \
+  ((1 << LITLEN_TABLE_BITS) + 288 * (1 << (15 - LITLEN_TABLE_BITS)))
+#define DIST_TABLE_SIZE                                                        \
+  ((1 << DIST_TABLE_BITS) + 32 * (1 << (15 - DIST_TABLE_BITS)))
+#define PRECODE_TABLE_SIZE (1 << PRECODE_TABLE_BITS)
+
+// Table entries. The low five bits are the number of bits to consume, and
+// the next two the kind of entry:
+//   ENTRY_VALUE: for the literal/length table, a literal in bits 8-15, and a
+//     second one in bits 16-23 if bit 7 is set. For the distance table, the
+//     base distance in bits 8-23 and number of extra bits in 24-28. For the
+//     precode, the code length symbol in bits 8-15.
+//   ENTRY_LENGTH: the base length in bits 8-23, extra bits in 24-28.
+//   ENTRY_SUBTABLE: the subtable offset in bits 8-23, its index bits in 24-28.
+//   ENTRY_END: end of block, or an invalid code if bit 7 is set.
+#define ENTRY_VALUE 0u
+#define ENTRY_LENGTH 1u
+#define ENTRY_SUBTABLE 2u
+#define ENTRY_END 3u
+#define ENTRY_INVALID ((ENTRY_END << 5) | 0x80u)
+
+#define ENTRY_BITS(e) ((e)&0x1Fu)
+#define ENTRY_KIND(e) (((e) >> 5) & 3u)
+#define ENTRY_BASE(e) (((e) >> 8) & 0xFFFFu)
+#define ENTRY_EXTRA(e) (((e) >> 24) & 0x1Fu)
+
+#define MASK(n) ((((uint64_t)1) << (n)) - 1)
+
+static const uint16_t s_length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t s_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                           1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                           4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t s_dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t s_dist_extra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                         4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                         9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t s_precode_order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                            11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+struct fast_inflater {
+  uint32_t litlen[LITLEN_TABLE_SIZE];
+  uint32_t dist[DIST_TABLE_SIZE];
+  uint32_t precode[PRECODE_TABLE_SIZE];
+  // Whether the tables hold the fixed code, so consecutive fixed blocks don't
+  // need to rebuild them.
+  int fixed;
+};
+
+static uint64_t load_le64(const uint8_t *p) {
+#if FAST_INFLATE_LITTLE_ENDIAN
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+#else
+  return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+         ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) |
+         ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) |
+         ((uint64_t)p[7] << 56);
+#endif
+}
+
+static unsigned reverse_bits(unsigned code, unsigned len) {
+  unsigned reversed = 0;
+  while (len--) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  return reversed;
+}
+
+// Builds a decode table from canonical Huffman code lengths. payloads holds
+// each symbol's entry, without the bit count. Incomplete codes are accepted;
+// missing codes decode to invalid entries.
+// Returns 0 on success, or -1 if the code is over-subscribed.
+static int build_table(uint32_t *table, unsigned table_bits,
+                       const uint8_t *lens, const uint32_t *payloads,
+                       unsigned count) {
+  unsigned len_counts[16] = {0}, next_code[16];
+  uint8_t sub_bits[1 << LITLEN_TABLE_BITS];
+  unsigned size = 1u << table_bits, next, sym, len, i;
+  int left = 1;
+
+  for (sym = 0; sym < count; sym++)
+    len_counts[lens[sym]]++;
+  len_counts[0] = 0;
+  for (len = 1; len <= 15; len++) {
+    left = (left << 1) - (int)len_counts[len];
+    if (left < 0)
+      return -1;
+  }
+  next_code[1] = 0;
+  for (len = 2; len <= 15; len++)
+    next_code[len] = (next_code[len - 1] + len_counts[len - 1]) << 1;
+
+  // Size subtables after the longest code sharing their prefix.
+  memset(sub_bits, 0, size);
+  {
+    unsigned codes[16];
+    memcpy(codes, next_code, sizeof(codes));
+    for (sym = 0; sym < count; sym++) {
+      len = lens[sym];
+      if (len > table_bits) {
+        unsigned prefix = reverse_bits(codes[len], len) & (size - 1);
+        if (len - table_bits > sub_bits[prefix])
+          sub_bits[prefix] = (uint8_t)(len - table_bits);
+      }
+      codes[len]++;
+    }
+  }
+  for (i = 0; i < size; i++)
+    table[i] = ENTRY_INVALID;
+  next = size;
+  for (i = 0; i < size; i++) {
+    if (sub_bits[i]) {
+      unsigned j, sub_size = 1u << sub_bits[i];
+      table[i] = (ENTRY_SUBTABLE << 5) | table_bits | (next << 8) |
+                 ((uint32_t)sub_bits[i] << 24);
+      for (j = 0; j < sub_size; j++)
+        table[next + j] = ENTRY_INVALID;
+      next += sub_size;
+    }
+  }
+
+  for (sym = 0; sym < count; sym++) {
+    unsigned code;
+    len = lens[sym];
+    if (!len)
+      continue;
+    code = reverse_bits(next_code[len]++, len);
+    if (len <= table_bits) {
+      for (i = code; i < size; i += 1u << len)
+        table[i] = payloads[sym] | len;
+    } else {
+      uint32_t sub = table[code & (size - 1)];
+      unsigned sub_size = 1u << ENTRY_EXTRA(sub);
+      for (i = code >> table_bits; i < sub_size; i += 1u << (len - table_bits))
+        table[ENTRY_BASE(sub) + i] = payloads[sym] | (len - table_bits);
+    }
+  }
+  return 0;
+}
+
+// Where a literal's code leaves room in the first level of the table for the
+// code of another literal, decode both with one lookup.
+static void pair_literals(uint32_t *table) {
+  uint32_t single[1 << LITLEN_TABLE_BITS];
+  unsigned i;
+  memcpy(single, table, sizeof(single));
+  for (i = 0; i < (1u << LITLEN_TABLE_BITS); i++) {
+    uint32_t first = single[i], second;
+    unsigned bits = ENTRY_BITS(first);
+    if (ENTRY_KIND(first) != ENTRY_VALUE || bits >= LITLEN_TABLE_BITS)
+      continue;
+    second = single[i >> bits];
+    if (ENTRY_KIND(second) != ENTRY_VALUE ||
+        bits + ENTRY_BITS(second) > LITLEN_TABLE_BITS)
+      continue;
+    table[i] = (first & ~0x1Fu) | 0x80u | ((second & 0xFF00u) << 8) |
+               (bits + ENTRY_BITS(second));
+  }
+}
+
+static int build_litlen_table(struct fast_inflater *d, const uint8_t *lens,
+                              unsigned count) {
+  uint32_t payloads[288];
+  unsigned sym;
+  for (sym = 0; sym < count; sym++) {
+    if (sym < 256)
+      payloads[sym] = (ENTRY_VALUE << 5) | (sym << 8);
+    else if (sym == 256)
+      payloads[sym] = ENTRY_END << 5;
+    else if (sym < 286)
+      payloads[sym] = (ENTRY_LENGTH << 5) |
+                      ((uint32_t)s_length_base[sym - 257] << 8) |
+                      ((uint32_t)s_length_extra[sym - 257] << 24);
+    else
+      payloads[sym] = ENTRY_INVALID;
+  }
+  if (build_table(d->litlen, LITLEN_TABLE_BITS, lens, payloads, count) < 0)
+    return -1;
+  pair_literals(d->litlen);
+  return 0;
+}
+
+static int build_dist_table(struct fast_inflater *d, const uint8_t *lens,
+                            unsigned count) {
+  uint32_t payloads[32];
+  unsigned sym;
+  for (sym = 0; sym < count; sym++) {
+    if (sym < 30)
+      payloads[sym] = (ENTRY_VALUE << 5) | ((uint32_t)s_dist_base[sym] << 8) |
+                      ((uint32_t)s_dist_extra[sym] << 24);
+    else
+      payloads[sym] = ENTRY_INVALID;
+  }
+  return build_table(d->dist, DIST_TABLE_BITS, lens, payloads, count);
+}
+
+static int build_fixed_tables(struct fast_inflater *d) {
+  uint8_t lens[288];
+  memset(lens, 8, 144);
+  memset(lens + 144, 9, 112);
+  memset(lens + 256, 7, 24);
+  memset(lens + 280, 8, 8);
+  if (build_litlen_table(d, lens, 288) < 0)
+    return -1;
+  memset(lens, 5, 32);
+  return build_dist_table(d, lens, 32);
+}
+
+// The input is read into a 64-bit buffer, eight bytes at a time while there
+// are that many left. Bits above bitsleft may hold input that is not counted
+// as read yet; it is read again to the same position on the next refill.
+// Past the end of the input, refills pad with zero bytes, counted in overrun.
+// A valid stream never consumes those.
+#define REFILL()                                                               \
+  do {                                                                         \
+    if (in_end - in_next >= 8) {                                               \
+      bitbuf |= load_le64(in_next) << bitsleft;                                \
+      in_next += (63 - bitsleft) >> 3;                                         \
+      bitsleft |= 56;                                                          \
+    } else {                                                                   \
+      while (bitsleft <= 56) {                                                 \
+        if (in_next < in_end)                                                  \
+          bitbuf |= (uint64_t)*in_next++ << bitsleft;                          \
+        else if (++overrun > 8)                                                \
+          goto cleanup;                                                        \
+        bitsleft += 8;                                                         \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define CONSUME(n)                                                             \
+  do {                                                                         \
+    bitbuf >>= (n);                                                            \
+    bitsleft -= (n);                                                           \
+  } while (0)
+
+int fast_inflate(const void *in, size_t in_size, void *out, size_t out_size,
+                 size_t *out_written) {
+  const uint8_t *in_next = (const uint8_t *)in;
+  const uint8_t *in_end = in_next + in_size;
+  uint8_t *out_start = (uint8_t *)out;
+  uint8_t *out_next = out_start;
+  uint8_t *out_end = out_start + out_size;
+  uint64_t bitbuf = 0;
+  unsigned bitsleft = 0;
+  size_t overrun = 0;
+  unsigned final = 0, type;
+  int status = -1;
+  struct fast_inflater *d;
+
+  d = (struct fast_inflater *)malloc(sizeof(struct fast_inflater));
+  if (!d)
+    return -1;
+  d->fixed = 0;
+
+  do {
+    REFILL();
+    final = (unsigned)(bitbuf & 1);
+    type = (unsigned)((bitbuf >> 1) & 3);
+    CONSUME(3);
+
+    if (type == 0) {
+      // Stored block. Skip to the byte boundary, and give back whole bytes
+      // still in the bit buffer.
+      size_t len, unread;
+      CONSUME(bitsleft & 7);
+      unread = bitsleft >> 3;
+      if (unread < overrun)
+        goto cleanup;
+      in_next -= unread - overrun;
+      overrun = 0;
+      bitbuf = 0;
+      bitsleft = 0;
+
+      if (in_end - in_next < 4)
+        goto cleanup;
+      len = (size_t)in_next[0] | ((size_t)in_next[1] << 8);
+      if (len != (~((size_t)in_next[2] | ((size_t)in_next[3] << 8)) & 0xFFFF))
+        goto cleanup;
+      in_next += 4;
+      if (len > (size_t)(in_end - in_next) ||
+          len > (size_t)(out_end - out_next))
+        goto cleanup;
+      memcpy(out_next, in_next, len);
+      in_next += len;
+      out_next += len;
+      continue;
+    }
+
+    if (type == 1) {
+      if (!d->fixed && build_fixed_tables(d) < 0)
+        goto cleanup;
+      d->fixed = 1;
+    } else if (type == 2) {
+      uint8_t lens[288 + 32], precode_lens[19];
+      uint32_t precode_payloads[19];
+      unsigned hlit, hdist, hclen, i;
+
+      REFILL();
+      hlit = (unsigned)(bitbuf & 0x1F) + 257;
+      hdist = (unsigned)((bitbuf >> 5) & 0x1F) + 1;
+      hclen = (unsigned)((bitbuf >> 10) & 0xF) + 4;
+      CONSUME(14);
+      if (hlit > 286 || hdist > 30)
+        goto cleanup;
+
+      memset(precode_lens, 0, sizeof(precode_lens));
+      for (i = 0; i < hclen; i++) {
+        if (bitsleft < 3)
+          REFILL();
+        precode_lens[s_precode_order[i]] = (uint8_t)(bitbuf & 7);
+        CONSUME(3);
+      }
+      for (i = 0; i < 19; i++)
+        precode_payloads[i] = (ENTRY_VALUE << 5) | (i << 8);
+      if (build_table(d->precode, PRECODE_TABLE_BITS, precode_lens,
+                      precode_payloads, 19) < 0)
+        goto cleanup;
+
+      i = 0;
+      while (i < hlit + hdist) {
+        uint32_t e;
+        unsigned sym, repeat;
+        uint8_t value = 0;
+        if (bitsleft < 14)
+          REFILL();
+        e = d->precode[bitbuf & MASK(PRECODE_TABLE_BITS)];
+        if (ENTRY_KIND(e) != ENTRY_VALUE)
+          goto cleanup;
+        CONSUME(ENTRY_BITS(e));
+        sym = ENTRY_BASE(e);
+        if (sym < 16) {
+          lens[i++] = (uint8_t)sym;
+          continue;
+        }
+        if (sym == 16) {
+          if (i == 0)
+            goto cleanup;
+          value = lens[i - 1];
+          repeat = 3 + (unsigned)(bitbuf & 3);
+          CONSUME(2);
+        } else if (sym == 17) {
+          repeat = 3 + (unsigned)(bitbuf & 7);
+          CONSUME(3);
+        } else {
+          repeat = 11 + (unsigned)(bitbuf & 0x7F);
+          CONSUME(7);
+        }
+        if (repeat > hlit + hdist - i)
+          goto cleanup;
+        memset(lens + i, value, repeat);
+        i += repeat;
+      }
+
+      // A block without an end-of-block code can't end.
+      if (!lens[256])
+        goto cleanup;
+      if (build_litlen_table(d, lens, hlit) < 0 ||
+          build_dist_table(d, lens + hlit, hdist) < 0)
+        goto cleanup;
+      d->fixed = 0;
+    } else {
+      goto cleanup;
+    }
+
+    // Decode the block. After a refill there are at least 56 bits available,
+    // which covers a length code, its extra bits, and a distance code with
+    // its extra bits (at most 48 bits).
+    for (;;) {
+      uint32_t e;
+      size_t length, distance;
+
+      REFILL();
+      e = d->litlen[bitbuf & MASK(LITLEN_TABLE_BITS)];
+      if (ENTRY_KIND(e) == ENTRY_SUBTABLE) {
+        CONSUME(LITLEN_TABLE_BITS);
+        e = d->litlen[ENTRY_BASE(e) + (bitbuf & MASK(ENTRY_EXTRA(e)))];
+      }
+      CONSUME(ENTRY_BITS(e));
+
+      if (ENTRY_KIND(e) == ENTRY_VALUE) {
+        if (out_end - out_next >= 2) {
+          // Store both literals, but only count the second if there is one.
+          // A spare byte is overwritten by whatever follows.
+          out_next[0] = (uint8_t)(e >> 8);
+          out_next[1] = (uint8_t)(e >> 16);
+          out_next += 1 + ((e >> 7) & 1);
+        } else {
+          if (out_next == out_end || (e & 0x80u))
+            goto cleanup;
+          *out_next++ = (uint8_t)(e >> 8);
+        }
+        continue;
+      }
+      if (ENTRY_KIND(e) == ENTRY_END) {
+        if (e & 0x80u)
+          goto cleanup;
+        break;
+      }
+
+      length = ENTRY_BASE(e) + (size_t)(bitbuf & MASK(ENTRY_EXTRA(e)));
+      CONSUME(ENTRY_EXTRA(e));
+
+      e = d->dist[bitbuf & MASK(DIST_TABLE_BITS)];
+      if (ENTRY_KIND(e) == ENTRY_SUBTABLE) {
+        CONSUME(DIST_TABLE_BITS);
+        e = d->dist[ENTRY_BASE(e) + (bitbuf & MASK(ENTRY_EXTRA(e)))];
+      }
+      if (ENTRY_KIND(e) != ENTRY_VALUE)
+        goto cleanup;
+      CONSUME(ENTRY_BITS(e));
+      distance = ENTRY_BASE(e) + (size_t)(bitbuf & MASK(ENTRY_EXTRA(e)));
+      CONSUME(ENTRY_EXTRA(e));
+
+      if (distance > (size_t)(out_next - out_start) ||
+          length > (size_t)(out_end - out_next))
+        goto cleanup;
+
+      {
+        const uint8_t *src = out_next - distance;
+        uint8_t *end = out_next + length;
+        if (distance >= 8 && out_end - end >= 8) {
+          // Copy eight bytes at a time. This may write up to seven bytes past
+          // the match, which are overwritten by whatever follows.
+          do {
+            memcpy(out_next, src, 8);
+            out_next += 8;
+            src += 8;
+          } while (out_next < end);
+          out_next = end;
+        } else if (distance == 1) {
+          memset(out_next, *src, length);
+          out_next = end;
+        } else {
+          do {
+            *out_next++ = *src++;
+          } while (out_next < end);
+        }
+      }
+    }
+  } while (!final);
+
+  // The stream must end within the input, not in the padding.
+  if (overrun > (bitsleft >> 3))
+    goto cleanup;
+
+  status = 0;
+  if (out_written)
+    *out_written = (size_t)(out_next - out_start);
+
+cleanup:
+  free(d);
+  return status;
+}
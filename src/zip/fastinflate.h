@@ -0,0 +1,45 @@
+/*
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef FASTINFLATE_H
+#define FASTINFLATE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Decompresses a complete raw deflate stream (RFC 1951) in one go.
+  Unlike tinfl, this cannot be resumed with more input, which lets it read
+  the input 64 bits at a time, decode up to two literals per table lookup,
+  and copy matches eight bytes at a time.
+
+  Args:
+    in: deflate stream.
+    in_size: stream size (in bytes).
+    out: output buffer.
+    out_size: output buffer size (in bytes).
+    out_written: receives the number of bytes written (optional).
+
+  Returns:
+    The return code - 0 on success, negative number (< 0) on error (e.g. the
+    stream is invalid, truncated, or does not fit in the output buffer).
+*/
+extern int fast_inflate(const void *in, size_t in_size, void *out,
+                        size_t out_size, size_t *out_written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
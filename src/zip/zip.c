@@ -39,6 +39,10 @@ int symlink(const char *target, const char *linkpath); // needed on Linux
 #include "miniz.h"
 #include "zip.h"
 
+#ifdef ZIP_FAST_INFLATE
+#include "fastinflate.h"
+#endif
+
 #ifndef HAS_DEVICE
 #define HAS_DEVICE(P) 0
 #endif
@@ -141,6 +145,7 @@ struct zip_entry_t {
 struct zip_t {
   mz_zip_archive archive;
   mz_uint level;
+  mz_uint read_flags;
   struct zip_entry_t entry;
 };
 
@@ -200,6 +205,46 @@ cleanup:
   return NULL;
 }
 
+struct zip_t *zip_stream_open(const char *stream, size_t size, int level,
+                              char mode) {
+  struct zip_t *zip = NULL;
+
+  if (!stream || !size) {
+    // zip_t stream is empty or NULL
+    goto cleanup;
+  }
+
+  if (level < 0)
+    level = MZ_DEFAULT_LEVEL;
+  if ((level & 0xF) > MZ_UBER_COMPRESSION) {
+    // Wrong compression level
+    goto cleanup;
+  }
+
+  if (mode != 'r') {
+    // Only reading is supported for streams
+    goto cleanup;
+  }
+
+  zip = (struct zip_t *)calloc((size_t)1, sizeof(struct zip_t));
+  if (!zip)
+    goto cleanup;
+
+  zip->level = (mz_uint)level;
+  if (!mz_zip_reader_init_mem(
+          &(zip->archive), stream, size,
+          zip->level | MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY)) {
+    // Cannot initialize zip_archive reader
+    goto cleanup;
+  }
+
+  return zip;
+
+cleanup:
+  CLEANUP(zip);
+  return NULL;
+}
+
 void zip_close(struct zip_t *zip) {
   if (zip) {
     // Always finalize, even if adding failed for some reason, so we have a
@@ -643,6 +688,180 @@ ssize_t zip_entry_read(struct zip_t *zip, void **buf, size_t *bufsize) {
   return size;
 }
 
+// Reads what extraction needs to know about an entry from the central
+// directory. Unlike mz_zip_reader_file_stat, this skips the name, comment and
+// time; converting the time calls mktime, which is slow and takes a lock.
+static int zip_entry_stat(mz_zip_archive *pzip, mz_uint index,
+                          mz_zip_archive_file_stat *stat) {
+  const mz_uint8 *p = mz_zip_reader_get_cdh(pzip, index);
+  if (!p) {
+    return -1;
+  }
+
+  memset(stat, 0, sizeof(mz_zip_archive_file_stat));
+  stat->m_file_index = index;
+  stat->m_bit_flag = MZ_READ_LE16(p + MZ_ZIP_CDH_BIT_FLAG_OFS);
+  stat->m_method = MZ_READ_LE16(p + MZ_ZIP_CDH_METHOD_OFS);
+  stat->m_crc32 = MZ_READ_LE32(p + MZ_ZIP_CDH_CRC32_OFS);
+  stat->m_comp_size = MZ_READ_LE32(p + MZ_ZIP_CDH_COMPRESSED_SIZE_OFS);
+  stat->m_uncomp_size = MZ_READ_LE32(p + MZ_ZIP_CDH_DECOMPRESSED_SIZE_OFS);
+  stat->m_local_header_ofs = MZ_READ_LE32(p + MZ_ZIP_CDH_LOCAL_HEADER_OFS);
+  return 0;
+}
+
+// Finds where an entry's data starts. The data follows its local header,
+// whose name and extra field lengths may differ from the central directory.
+static int zip_entry_data_offset(mz_zip_archive *pzip,
+                                 const mz_zip_archive_file_stat *stat,
+                                 mz_uint64 *offset) {
+  mz_uint32 local_header_u32[(MZ_ZIP_LOCAL_DIR_HEADER_SIZE + sizeof(mz_uint32) -
+                              1) /
+                             sizeof(mz_uint32)];
+  mz_uint8 *pLocal_header = (mz_uint8 *)local_header_u32;
+
+  if (pzip->m_pRead(pzip->m_pIO_opaque, stat->m_local_header_ofs,
+                    pLocal_header, MZ_ZIP_LOCAL_DIR_HEADER_SIZE) !=
+      MZ_ZIP_LOCAL_DIR_HEADER_SIZE) {
+    return -1;
+  }
+  if (MZ_READ_LE32(pLocal_header) != MZ_ZIP_LOCAL_DIR_HEADER_SIG) {
+    return -1;
+  }
+  *offset = stat->m_local_header_ofs + MZ_ZIP_LOCAL_DIR_HEADER_SIZE +
+            MZ_READ_LE16(pLocal_header + MZ_ZIP_LDH_FILENAME_LEN_OFS) +
+            MZ_READ_LE16(pLocal_header + MZ_ZIP_LDH_EXTRA_LEN_OFS);
+  if (*offset + stat->m_comp_size > pzip->m_archive_size) {
+    return -1;
+  }
+  return 0;
+}
+
+#ifdef ZIP_FAST_INFLATE
+// Inflates an entry with fast_inflate instead of tinfl. The whole compressed
+// entry is needed at once; it is read from the stream directly, or into a
+// temporary buffer for archives opened from a file.
+static ssize_t zip_entry_fastinflate(struct zip_t *zip,
+                                     const mz_zip_archive_file_stat *stat,
+                                     void *buf, size_t bufsize) {
+  mz_zip_archive *pzip = &(zip->archive);
+  mz_uint64 data_ofs;
+  const void *comp = NULL;
+  void *comp_buf = NULL;
+  size_t comp_size = (size_t)stat->m_comp_size;
+  size_t written = 0;
+  ssize_t status = -1;
+
+  if (bufsize < stat->m_uncomp_size || (stat->m_bit_flag & (1 | 32)) ||
+      zip_entry_data_offset(pzip, stat, &data_ofs) < 0) {
+    return -1;
+  }
+
+  if (pzip->m_pState->m_pMem) {
+    comp = (const mz_uint8 *)pzip->m_pState->m_pMem + data_ofs;
+  } else {
+    comp_buf = malloc(comp_size ? comp_size : 1);
+    if (!comp_buf) {
+      return -1;
+    }
+    if (pzip->m_pRead(pzip->m_pIO_opaque, data_ofs, comp_buf, comp_size) !=
+        comp_size) {
+      goto cleanup;
+    }
+    comp = comp_buf;
+  }
+
+  if (fast_inflate(comp, comp_size, buf, (size_t)stat->m_uncomp_size,
+                   &written) < 0 ||
+      written != stat->m_uncomp_size) {
+    goto cleanup;
+  }
+  if (!(zip->read_flags & MZ_ZIP_FLAG_SKIP_CRC_CHECK) &&
+      mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)buf, written) !=
+          stat->m_crc32) {
+    goto cleanup;
+  }
+  status = (ssize_t)written;
+
+cleanup:
+  CLEANUP(comp_buf);
+  return status;
+}
+#endif
+
+// Both read functions only look at the central directory and the entry, and
+// keep all other state on the stack, so they leave the handler untouched.
+static ssize_t zip_entry_noallocread_stat(struct zip_t *zip, mz_uint index,
+                                          void *buf, size_t bufsize) {
+  mz_zip_archive *pzip = &(zip->archive);
+  mz_zip_archive_file_stat stat;
+
+  if (zip_entry_stat(pzip, index, &stat) < 0) {
+    return -1;
+  }
+
+  if (stat.m_method == 0 && stat.m_comp_size == stat.m_uncomp_size &&
+      !(stat.m_bit_flag & (1 | 32))) {
+    // Stored; just copy the data.
+    mz_uint64 data_ofs;
+    size_t size = (size_t)stat.m_uncomp_size;
+    if (bufsize < size || zip_entry_data_offset(pzip, &stat, &data_ofs) < 0 ||
+        pzip->m_pRead(pzip->m_pIO_opaque, data_ofs, buf, size) != size) {
+      return -1;
+    }
+    if (!(zip->read_flags & MZ_ZIP_FLAG_SKIP_CRC_CHECK) &&
+        mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)buf, size) != stat.m_crc32) {
+      return -1;
+    }
+    return (ssize_t)size;
+  }
+
+#ifdef ZIP_FAST_INFLATE
+  if (stat.m_method == MZ_DEFLATED && stat.m_comp_size > 0 &&
+      !mz_zip_reader_is_file_a_directory(pzip, index)) {
+    return zip_entry_fastinflate(zip, &stat, buf, bufsize);
+  }
+#endif
+
+  if (!mz_zip_reader_extract_to_mem_no_alloc(pzip, index, buf, bufsize,
+                                             zip->read_flags, NULL, 0)) {
+    return -1;
+  }
+
+  return (ssize_t)stat.m_uncomp_size;
+}
+
+static ssize_t zip_entry_mapread_stat(struct zip_t *zip, mz_uint index,
+                                      const void **buf) {
+  mz_zip_archive *pzip = &(zip->archive);
+  mz_zip_archive_file_stat stat;
+  mz_uint64 data_ofs;
+
+  if (zip_entry_stat(pzip, index, &stat) < 0) {
+    return -1;
+  }
+
+  if (!pzip->m_pState->m_pMem || stat.m_method != 0 ||
+      stat.m_comp_size != stat.m_uncomp_size ||
+      (stat.m_bit_flag & (1 | 32))) {
+    // not a stream, or the entry needs to be inflated
+    return -1;
+  }
+
+  if (zip_entry_data_offset(pzip, &stat, &data_ofs) < 0) {
+    return -1;
+  }
+
+  *buf = (const mz_uint8 *)pzip->m_pState->m_pMem + data_ofs;
+  if (!(zip->read_flags & MZ_ZIP_FLAG_SKIP_CRC_CHECK) &&
+      mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)*buf,
+               (size_t)stat.m_uncomp_size) != stat.m_crc32) {
+    *buf = NULL;
+    return -1;
+  }
+
+  return (ssize_t)stat.m_uncomp_size;
+}
+
 ssize_t zip_entry_noallocread(struct zip_t *zip, void *buf, size_t bufsize) {
   mz_zip_archive *pzip = NULL;
 
@@ -657,12 +876,249 @@ ssize_t zip_entry_noallocread(struct zip_t *zip, void *buf, size_t bufsize) {
     return -1;
   }
 
-  if (!mz_zip_reader_extract_to_mem_no_alloc(pzip, (mz_uint)zip->entry.index,
-  buf, bufsize, 0, NULL,  0)) {
+  return zip_entry_noallocread_stat(zip, (mz_uint)zip->entry.index, buf,
+                                    bufsize);
+}
+
+ssize_t zip_entry_noallocreadbyindex(struct zip_t *zip, int index, void *buf,
+                                     size_t bufsize) {
+  mz_zip_archive *pzip = NULL;
+
+  if (!zip) {
+    // zip_t handler is not initialized
+    return -1;
+  }
+
+  pzip = &(zip->archive);
+  if (pzip->m_zip_mode != MZ_ZIP_MODE_READING || index < 0 ||
+      (mz_uint)index >= pzip->m_total_files) {
+    // the entry is not found or we do not have read access
+    return -1;
+  }
+
+  return zip_entry_noallocread_stat(zip, (mz_uint)index, buf, bufsize);
+}
+
+ssize_t zip_entry_mapread(struct zip_t *zip, const void **buf) {
+  mz_zip_archive *pzip = NULL;
+
+  if (!zip || !buf) {
+    // zip_t handler is not initialized
+    return -1;
+  }
+
+  pzip = &(zip->archive);
+  if (pzip->m_zip_mode != MZ_ZIP_MODE_READING || zip->entry.index < 0) {
+    // the entry is not found or we do not have read access
+    return -1;
+  }
+
+  return zip_entry_mapread_stat(zip, (mz_uint)zip->entry.index, buf);
+}
+
+ssize_t zip_entry_mapreadbyindex(struct zip_t *zip, int index,
+                                 const void **buf) {
+  mz_zip_archive *pzip = NULL;
+
+  if (!zip || !buf) {
+    // zip_t handler is not initialized
+    return -1;
+  }
+
+  pzip = &(zip->archive);
+  if (pzip->m_zip_mode != MZ_ZIP_MODE_READING || index < 0 ||
+      (mz_uint)index >= pzip->m_total_files) {
+    // the entry is not found or we do not have read access
+    return -1;
+  }
+
+  return zip_entry_mapread_stat(zip, (mz_uint)index, buf);
+}
+
+struct zip_entry_stream_t {
+  tinfl_decompressor inflator;
+  tinfl_status status;
+  mz_uint16 method;
+  int check_crc;
+  // Input left to read.
+  const mz_uint8 *in;
+  size_t in_remaining;
+  // Output so far, and the part of it not returned yet. For deflated
+  // entries, output goes through the dictionary, wrapping around.
+  mz_uint64 produced;
+  mz_uint64 uncomp_size;
+  size_t avail_ofs;
+  size_t avail;
+  mz_uint32 crc32;
+  mz_uint32 expected_crc32;
+  int checked;
+  mz_uint8 dict[TINFL_LZ_DICT_SIZE];
+};
+
+// Checks the entry's size and CRC-32 once all of it has been produced, which
+// may be before the caller has read it all. Returns -1 on a mismatch.
+static int zip_entry_stream_check(struct zip_entry_stream_t *stream) {
+  int done = stream->method == 0 ? !stream->in_remaining
+                                 : stream->status == TINFL_STATUS_DONE;
+  if (stream->checked || !done) {
+    return 0;
+  }
+  stream->checked = 1;
+  if (stream->produced != stream->uncomp_size ||
+      (stream->check_crc && stream->crc32 != stream->expected_crc32)) {
+    stream->status = TINFL_STATUS_FAILED;
+    return -1;
+  }
+  return 0;
+}
+
+struct zip_entry_stream_t *zip_entry_stream_open(struct zip_t *zip,
+                                                 int index) {
+  mz_zip_archive *pzip = NULL;
+  mz_zip_archive_file_stat stat;
+  mz_uint64 data_ofs;
+  struct zip_entry_stream_t *stream = NULL;
+
+  if (!zip) {
+    // zip_t handler is not initialized
+    return NULL;
+  }
+
+  pzip = &(zip->archive);
+  if (pzip->m_zip_mode != MZ_ZIP_MODE_READING || index < 0 ||
+      (mz_uint)index >= pzip->m_total_files) {
+    // the entry is not found or we do not have read access
+    return NULL;
+  }
+
+  if (!pzip->m_pState->m_pMem ||
+      zip_entry_stat(pzip, (mz_uint)index, &stat) < 0 ||
+      (stat.m_bit_flag & (1 | 32)) ||
+      (stat.m_method != 0 && stat.m_method != MZ_DEFLATED) ||
+      (stat.m_method == 0 && stat.m_comp_size != stat.m_uncomp_size) ||
+      zip_entry_data_offset(pzip, &stat, &data_ofs) < 0) {
+    // not a stream, or an entry we can't read
+    return NULL;
+  }
+
+  stream = (struct zip_entry_stream_t *)calloc(
+      (size_t)1, sizeof(struct zip_entry_stream_t));
+  if (!stream) {
+    return NULL;
+  }
+  tinfl_init(&stream->inflator);
+  stream->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+  stream->method = (mz_uint16)stat.m_method;
+  stream->check_crc = !(zip->read_flags & MZ_ZIP_FLAG_SKIP_CRC_CHECK);
+  stream->in = (const mz_uint8 *)pzip->m_pState->m_pMem + data_ofs;
+  stream->in_remaining = (size_t)stat.m_comp_size;
+  stream->uncomp_size = stat.m_uncomp_size;
+  stream->crc32 = MZ_CRC32_INIT;
+  stream->expected_crc32 = stat.m_crc32;
+  return stream;
+}
+
+// Inflates the next chunk into the dictionary. Returns -1 on error.
+static int zip_entry_stream_inflate(struct zip_entry_stream_t *stream) {
+  size_t in_size = stream->in_remaining;
+  size_t out_ofs = (size_t)(stream->produced & (TINFL_LZ_DICT_SIZE - 1));
+  size_t out_size = TINFL_LZ_DICT_SIZE - out_ofs;
+
+  stream->status =
+      tinfl_decompress(&stream->inflator, stream->in, &in_size, stream->dict,
+                       stream->dict + out_ofs, &out_size, 0);
+  stream->in += in_size;
+  stream->in_remaining -= in_size;
+  if (stream->status < 0 ||
+      (stream->status == TINFL_STATUS_NEEDS_MORE_INPUT &&
+       !stream->in_remaining) ||
+      stream->produced + out_size > stream->uncomp_size) {
+    // broken data, or more of it than the entry claims
+    return -1;
+  }
+
+  if (stream->check_crc) {
+    stream->crc32 = (mz_uint32)mz_crc32(stream->crc32,
+                                        stream->dict + out_ofs, out_size);
+  }
+  stream->avail_ofs = out_ofs;
+  stream->avail = out_size;
+  stream->produced += out_size;
+  return 0;
+}
+
+ssize_t zip_entry_stream_read(struct zip_entry_stream_t *stream, void *buf,
+                              size_t bufsize) {
+  mz_uint8 *out = (mz_uint8 *)buf;
+  size_t total = 0;
+
+  if (!stream || stream->status < 0) {
     return -1;
   }
 
-  return (ssize_t)zip->entry.uncomp_size;
+  while (total < bufsize) {
+    size_t n;
+    if (stream->avail) {
+      n = MZ_MIN(stream->avail, bufsize - total);
+      memcpy(out + total, stream->dict + stream->avail_ofs, n);
+      stream->avail_ofs += n;
+      stream->avail -= n;
+      total += n;
+      continue;
+    }
+
+    if (stream->method == 0) {
+      // Stored; copy straight from the input.
+      n = MZ_MIN(stream->in_remaining, bufsize - total);
+      if (!n) {
+        break;
+      }
+      memcpy(out + total, stream->in, n);
+      if (stream->check_crc) {
+        stream->crc32 = (mz_uint32)mz_crc32(stream->crc32, stream->in, n);
+      }
+      stream->in += n;
+      stream->in_remaining -= n;
+      stream->produced += n;
+      total += n;
+      continue;
+    }
+
+    if (stream->status == TINFL_STATUS_DONE) {
+      break;
+    }
+    if (zip_entry_stream_inflate(stream) < 0) {
+      stream->status = TINFL_STATUS_FAILED;
+      return -1;
+    }
+  }
+
+  if (zip_entry_stream_check(stream) < 0) {
+    return -1;
+  }
+
+  return (ssize_t)total;
+}
+
+unsigned long long zip_entry_stream_size(struct zip_entry_stream_t *stream) {
+  return stream ? stream->uncomp_size : 0;
+}
+
+int zip_entry_stream_close(struct zip_entry_stream_t *stream) {
+  mz_uint8 scratch[4096];
+  int result;
+
+  if (!stream) {
+    return -1;
+  }
+
+  // Read what the caller left, so the entry is still checked as a whole.
+  while (stream->check_crc && !stream->checked && stream->status >= 0 &&
+         zip_entry_stream_read(stream, scratch, sizeof(scratch)) > 0) {
+  }
+  result = stream->status < 0 ? -1 : 0;
+  CLEANUP(stream);
+  return result;
 }
 
 int zip_entry_fread(struct zip_t *zip, const char *filename) {
@@ -744,6 +1200,19 @@ int zip_total_entries(struct zip_t *zip) {
   return (int)zip->archive.m_total_files;
 }
 
+void zip_set_crc_check(struct zip_t *zip, int enabled) {
+  if (!zip) {
+    // zip_t handler is not initialized
+    return;
+  }
+
+  if (enabled) {
+    zip->read_flags &= ~(mz_uint)MZ_ZIP_FLAG_SKIP_CRC_CHECK;
+  } else {
+    zip->read_flags |= MZ_ZIP_FLAG_SKIP_CRC_CHECK;
+  }
+}
+
 int zip_create(const char *zipname, const char *filenames[], size_t len) {
   int status = 0;
   size_t i;
@@ -52,6 +52,24 @@ struct zip_t;
 */
 extern struct zip_t *zip_open(const char *zipname, int level, char mode);
 
+/*
+  Opens zip archive stream into memory.
+  Only reading is supported; the stream is not copied, and must stay valid
+  until the archive is closed. This is useful with a memory-mapped file.
+
+  Args:
+    stream: zip archive stream.
+    size: stream size.
+    level: compression level (0-9 are the standard zlib-style levels).
+    mode: file access mode.
+        'r': opens a stream for reading/extracting.
+
+  Returns:
+    The zip archive handler or NULL on error
+*/
+extern struct zip_t *zip_stream_open(const char *stream, size_t size,
+                                     int level, char mode);
+
 /*
   Closes the zip archive, releases resources - always finalize.
 
@@ -225,6 +243,141 @@ extern ssize_t zip_entry_read(struct zip_t *zip, void **buf, size_t *bufsize);
 */
 extern ssize_t zip_entry_noallocread(struct zip_t *zip, void *buf, size_t bufsize);
 
+/*
+  Gets the current zip entry's data without copying it.
+  This only works for archives opened with zip_stream_open, and entries stored
+  without compression. The CRC-32 checksum is verified, unless disabled with
+  zip_set_crc_check.
+
+  Args:
+    zip: zip archive handler.
+    buf: receives a pointer to the entry data within the stream.
+
+  Note:
+    - the data stays valid for as long as the stream does.
+    - for other entries, use zip_entry_noallocread.
+
+  Returns:
+    The return code - the number of bytes on success.
+    Otherwise a -1 on error (e.g. the entry is compressed).
+*/
+extern ssize_t zip_entry_mapread(struct zip_t *zip, const void **buf);
+
+/*
+  Extracts the entry at index into a memory buffer using no memory
+  allocation, without opening it as the current entry.
+
+  Args:
+    zip: zip archive handler.
+    index: index in local dictionary.
+    buf: preallocated output buffer.
+    bufsize: output buffer size (in bytes).
+
+  Note:
+    - the handler is not changed, so for archives opened with
+      zip_stream_open, several threads can read entries at the same time.
+      Archives opened from a file share one file position, and must be read
+      by one thread at a time.
+    - don't call zip_set_crc_check while reads are in progress.
+
+  Returns:
+    The return code - the number of bytes actually read on success.
+    Otherwise a -1 on error (e.g. bufsize is not large enough).
+*/
+extern ssize_t zip_entry_noallocreadbyindex(struct zip_t *zip, int index,
+                                            void *buf, size_t bufsize);
+
+/*
+  Gets the data of the entry at index without copying it, and without
+  opening it as the current entry. Like zip_entry_mapread, this only works for
+  archives opened with zip_stream_open, and entries stored without
+  compression.
+
+  Args:
+    zip: zip archive handler.
+    index: index in local dictionary.
+    buf: receives a pointer to the entry data within the stream.
+
+  Note:
+    - the handler is not changed, so several threads can call this at the
+      same time.
+    - don't call zip_set_crc_check while reads are in progress.
+
+  Returns:
+    The return code - the number of bytes on success.
+    Otherwise a -1 on error (e.g. the entry is compressed).
+*/
+extern ssize_t zip_entry_mapreadbyindex(struct zip_t *zip, int index,
+                                        const void **buf);
+
+struct zip_entry_stream_t;
+
+/*
+  Opens the entry at index for reading in chunks. Deflated entries are
+  inflated as they are read, through a 32 KB window, so the whole entry never
+  has to be held in memory. Like zip_entry_mapread, this only works for
+  archives opened with zip_stream_open.
+
+  Args:
+    zip: zip archive handler.
+    index: index in local dictionary.
+
+  Note:
+    - the stream points into the archive's memory, which must stay valid
+      until the stream is closed; the handler itself may be closed earlier.
+    - CRC checks follow zip_set_crc_check at the time the stream is opened.
+
+  Returns:
+    The entry stream on success, or NULL on error (e.g. the archive is not a
+    stream, or the entry is encrypted or uses an unsupported method).
+*/
+extern struct zip_entry_stream_t *zip_entry_stream_open(struct zip_t *zip,
+                                                        int index);
+
+/*
+  Reads the next chunk of an entry stream.
+
+  Args:
+    stream: entry stream.
+    buf: output buffer.
+    bufsize: output buffer size (in bytes).
+
+  Note:
+    - the size and CRC are checked as soon as the end of the entry has been
+      inflated, even if the caller stops reading before it.
+
+  Returns:
+    The return code - the number of bytes read, which is less than bufsize
+    only at the end of the entry, and 0 once it is all read.
+    Otherwise a -1 on error (e.g. the data is corrupt, or its size or CRC
+    doesn't match the entry's).
+*/
+extern ssize_t zip_entry_stream_read(struct zip_entry_stream_t *stream,
+                                     void *buf, size_t bufsize);
+
+/*
+  Returns the uncompressed size of the entry (in bytes).
+
+  Args:
+    stream: entry stream.
+*/
+extern unsigned long long
+zip_entry_stream_size(struct zip_entry_stream_t *stream);
+
+/*
+  Closes an entry stream and frees its resources. With CRC checks on, the
+  rest of the entry is read first, so it is checked even if the caller
+  stopped early.
+
+  Args:
+    stream: entry stream.
+
+  Returns:
+    The return code - 0 if the entry is intact (or checks are off),
+    otherwise a -1 (e.g. its size or CRC doesn't match the entry's).
+*/
+extern int zip_entry_stream_close(struct zip_entry_stream_t *stream);
+
 /*
   Extracts the current zip entry into output file.
 
@@ -267,6 +420,22 @@ zip_entry_extract(struct zip_t *zip,
 */
 extern int zip_total_entries(struct zip_t *zip);
 
+/*
+  Sets whether entry data is checked against its CRC-32 checksum when read.
+  Checks are enabled by default.
+
+  Args:
+    zip: zip archive handler.
+    enabled: zero to skip checks, non-zero to enable them.
+
+  Note:
+    - only zip_entry_noallocread, zip_entry_mapread, their "byindex"
+      variants and entry streams skip checks.
+    - only disable checks for archives that are known to be intact, e.g.
+      verified earlier with zip_entry_extract.
+*/
+extern void zip_set_crc_check(struct zip_t *zip, int enabled);
+
 /*
   Creates a new archive and puts files into a single zip archive.
 